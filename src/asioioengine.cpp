@@ -0,0 +1,288 @@
+/*
+ * asioioengine.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "asioioengine.hpp"
+#include "memorygovernor.hpp"
+#include <boost/bind.hpp>
+
+namespace rtunnel {
+
+const std::size_t asio_io_engine::MAX_WRITE_BATCH = 64;
+
+asio_io_engine::asio_io_engine(boost::asio::io_service& io_service, packet_pool& pool) :
+		io_service(io_service), pool(pool), tickTimer(io_service), tickInterval(0) {
+}
+
+void asio_io_engine::watch(int fd, read_handler handler) {
+	descriptor_ptr d(new descriptor());
+	d->fd = fd;
+	d->stream = boost::shared_ptr<boost::asio::posix::stream_descriptor>(new boost::asio::posix::stream_descriptor(io_service, fd));
+	d->handler = handler;
+	d->reading = false;
+	d->paused = false;
+	d->queuedBytes = 0;
+	d->readIndex = pool.acquire();
+	if (d->readIndex < 0) {
+		d->readHeap.resize(pool.getBufferSize());
+	}
+	this->descriptors[fd] = d;
+	this->startRead(d);
+	if (descriptors.size() == 1) {
+		this->armTicker();
+	}
+}
+
+void asio_io_engine::unwatch(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end()) {
+		return;
+	}
+	// pending operations complete with operation_aborted and give their
+	// buffers back from the handlers.
+	boost::system::error_code ignored;
+	it->second->stream->close(ignored);
+	descriptors.erase(it);
+	if (descriptors.empty()) {
+		// an armed ticker would keep run() from returning.
+		tickTimer.cancel(ignored);
+	}
+}
+
+/**
+ * pending operations complete with operation_aborted; a read the reactor
+ * has already done is queued ahead of released.
+ */
+void asio_io_engine::release(int fd, boost::function<void()> released) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end()) {
+		return;
+	}
+	it->second->stream->release();
+	descriptors.erase(it);
+	if (descriptors.empty()) {
+		boost::system::error_code ignored;
+		tickTimer.cancel(ignored);
+	}
+	io_service.post(released);
+}
+
+/**
+ * copy data into pool buffers and queue it; everything queued while a write
+ * is in flight goes out as one gathered write.
+ */
+void asio_io_engine::write(int fd, const unsigned char* data, std::size_t len) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end()) {
+		return;
+	}
+	descriptor_ptr d = it->second;
+	d->queuedBytes += len;
+	memory_governor::instance().charge(len);
+	std::size_t bufferSize = pool.getBufferSize();
+	while (len > 0) {
+		chunk c;
+		c.len = std::min(len, bufferSize);
+		c.index = pool.acquire();
+		if (c.index >= 0) {
+			std::copy(data, data + c.len, pool.at(c.index));
+		} else {
+			c.heap = boost::shared_ptr<std::vector<unsigned char> >(new std::vector<unsigned char>(data, data + c.len));
+		}
+		d->pending.push_back(c);
+		data += c.len;
+		len -= c.len;
+	}
+	if (d->writing.empty()) {
+		this->startWrite(d);
+	}
+}
+
+void asio_io_engine::pauseReads(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it != descriptors.end()) {
+		it->second->paused = true;
+	}
+}
+
+void asio_io_engine::resumeReads(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || !it->second->paused) {
+		return;
+	}
+	it->second->paused = false;
+	if (!it->second->reading) {
+		this->startRead(it->second);
+	}
+}
+
+std::size_t asio_io_engine::getQueuedBytes(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	return it == descriptors.end() ? 0 : it->second->queuedBytes;
+}
+
+void asio_io_engine::setWriteHandler(int fd, write_handler handler) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it != descriptors.end()) {
+		it->second->writeHandler = handler;
+	}
+}
+
+void asio_io_engine::post(boost::function<void()> handler) {
+	this->io_service.post(handler);
+}
+
+void asio_io_engine::setTicker(int intervalMs, boost::function<void()> handler) {
+	this->tickInterval = intervalMs;
+	this->tickHandler = handler;
+	if (!descriptors.empty()) {
+		this->armTicker();
+	}
+}
+
+void asio_io_engine::armTicker() {
+	if (tickInterval <= 0) {
+		return;
+	}
+	tickTimer.expires_from_now(boost::posix_time::milliseconds(tickInterval));
+	tickTimer.async_wait(boost::bind(&asio_io_engine::handleTick, this, boost::asio::placeholders::error));
+}
+
+void asio_io_engine::handleTick(const boost::system::error_code& ec) {
+	if (ec || descriptors.empty()) {
+		return;
+	}
+	tickHandler();
+	if (!descriptors.empty()) {
+		this->armTicker();
+	}
+}
+
+void asio_io_engine::run() {
+	this->io_service.reset();
+	this->io_service.run();
+}
+
+void asio_io_engine::stop() {
+	this->io_service.post(boost::bind(&asio_io_engine::doStop, this));
+}
+
+std::string asio_io_engine::getName() {
+	return "asio";
+}
+
+unsigned char* asio_io_engine::readBuffer(descriptor_ptr d, std::size_t& len) {
+	if (d->readIndex >= 0) {
+		len = pool.getBufferSize();
+		return pool.at(d->readIndex);
+	}
+	len = d->readHeap.size();
+	return &d->readHeap[0];
+}
+
+void asio_io_engine::startRead(descriptor_ptr d) {
+	std::size_t len;
+	unsigned char* buffer = this->readBuffer(d, len);
+	d->reading = true;
+	d->stream->async_read_some(boost::asio::buffer(buffer, len),
+			boost::bind(&asio_io_engine::handleRead, this, d, boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+}
+
+void asio_io_engine::handleRead(descriptor_ptr d, const boost::system::error_code& ec, std::size_t len) {
+	d->reading = false;
+	if (ec) {
+		if (d->readIndex >= 0) {
+			pool.release(d->readIndex);
+			d->readIndex = -1;
+		}
+		this->fail(d, ec);
+		return;
+	}
+	std::size_t capacity;
+	unsigned char* buffer = this->readBuffer(d, capacity);
+	d->handler(d->fd, buffer, len, ec);
+	if (d->stream->is_open()) {
+		if (!d->paused) {
+			this->startRead(d);
+		}
+	} else if (d->readIndex >= 0) {
+		// unwatched from inside the handler.
+		pool.release(d->readIndex);
+		d->readIndex = -1;
+	}
+}
+
+void asio_io_engine::startWrite(descriptor_ptr d) {
+	std::vector<boost::asio::const_buffer> buffers;
+	while (!d->pending.empty() && d->writing.size() < MAX_WRITE_BATCH) {
+		chunk& c = d->pending.front();
+		buffers.push_back(boost::asio::buffer(c.index >= 0 ? pool.at(c.index) : &(*c.heap)[0], c.len));
+		d->writing.push_back(c);
+		d->pending.pop_front();
+	}
+	if (buffers.empty()) {
+		return;
+	}
+	boost::asio::async_write(*d->stream, buffers,
+			boost::bind(&asio_io_engine::handleWrite, this, d, boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+}
+
+void asio_io_engine::handleWrite(descriptor_ptr d, const boost::system::error_code& ec, std::size_t) {
+	for (std::size_t i = 0; i < d->writing.size(); i++) {
+		d->queuedBytes -= d->writing[i].len;
+		memory_governor::instance().credit(d->writing[i].len);
+		this->releaseChunk(d->writing[i]);
+	}
+	d->writing.clear();
+	if (ec) {
+		for (std::size_t i = 0; i < d->pending.size(); i++) {
+			this->releaseChunk(d->pending[i]);
+		}
+		d->pending.clear();
+		memory_governor::instance().credit(d->queuedBytes);
+		d->queuedBytes = 0;
+		this->fail(d, ec);
+		return;
+	}
+	this->startWrite(d);
+	if (d->writeHandler) {
+		d->writeHandler(d->fd, d->queuedBytes);
+	}
+}
+
+void asio_io_engine::releaseChunk(chunk& c) {
+	if (c.index >= 0) {
+		pool.release(c.index);
+		c.index = -1;
+	}
+}
+
+/**
+ * report the first error on a descriptor to its handler, then drop it.
+ */
+void asio_io_engine::fail(descriptor_ptr d, const boost::system::error_code& ec) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(d->fd);
+	if (it == descriptors.end() || it->second != d) {
+		// already unwatched, nobody to tell.
+		return;
+	}
+	d->handler(d->fd, NULL, 0, ec);
+	this->unwatch(d->fd);
+}
+
+void asio_io_engine::doStop() {
+	while (!descriptors.empty()) {
+		this->unwatch(descriptors.begin()->first);
+	}
+}
+
+asio_io_engine::~asio_io_engine() {
+	this->doStop();
+}
+
+} /* namespace rtunnel */
@@ -0,0 +1,83 @@
+/*
+ * asioioengine.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef ASIOIOENGINE_HPP_
+#define ASIOIOENGINE_HPP_
+
+#include <deque>
+#include <map>
+#include <vector>
+#include "ioengine.hpp"
+
+namespace rtunnel {
+
+/**
+ * io_engine on top of the asio reactor, available everywhere.
+ */
+class asio_io_engine: public io_engine {
+public:
+	asio_io_engine(boost::asio::io_service& io_service, packet_pool& pool);
+
+	void watch(int fd, read_handler handler);
+	void unwatch(int fd);
+	void release(int fd, boost::function<void()> released);
+	void write(int fd, const unsigned char* data, std::size_t len);
+	void pauseReads(int fd);
+	void resumeReads(int fd);
+	std::size_t getQueuedBytes(int fd);
+	void setWriteHandler(int fd, write_handler handler);
+	void post(boost::function<void()> handler);
+	void setTicker(int intervalMs, boost::function<void()> handler);
+	void run();
+	void stop();
+	std::string getName();
+
+	virtual ~asio_io_engine();
+private:
+	struct chunk {
+		int index;
+		std::size_t len;
+		boost::shared_ptr<std::vector<unsigned char> > heap;
+	};
+	struct descriptor {
+		int fd;
+		boost::shared_ptr<boost::asio::posix::stream_descriptor> stream;
+		read_handler handler;
+		write_handler writeHandler;
+		int readIndex;
+		bool reading;
+		bool paused;
+		std::vector<unsigned char> readHeap;
+		std::deque<chunk> pending;
+		std::vector<chunk> writing;
+		std::size_t queuedBytes;
+	};
+	typedef boost::shared_ptr<descriptor> descriptor_ptr;
+
+	static const std::size_t MAX_WRITE_BATCH;
+
+	boost::asio::io_service& io_service;
+	packet_pool& pool;
+	std::map<int, descriptor_ptr> descriptors;
+	boost::asio::deadline_timer tickTimer;
+	int tickInterval;
+	boost::function<void()> tickHandler;
+
+	unsigned char* readBuffer(descriptor_ptr d, std::size_t& len);
+	void startRead(descriptor_ptr d);
+	void handleRead(descriptor_ptr d, const boost::system::error_code& ec, std::size_t len);
+	void startWrite(descriptor_ptr d);
+	void handleWrite(descriptor_ptr d, const boost::system::error_code& ec, std::size_t len);
+	void releaseChunk(chunk& c);
+	void fail(descriptor_ptr d, const boost::system::error_code& ec);
+	void doStop();
+	void armTicker();
+	void handleTick(const boost::system::error_code& ec);
+};
+
+} /* namespace rtunnel */
+#endif /* ASIOIOENGINE_HPP_ */
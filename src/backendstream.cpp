@@ -0,0 +1,188 @@
+/*
+ * backendstream.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "backendstream.hpp"
+#include "shmring.hpp"
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <unistd.h>
+
+using boost::asio::ip::tcp;
+
+namespace rtunnel {
+
+backend_address backend_address::parse(const std::string& host, int port) {
+	backend_address address;
+	address.kind = TCP;
+	address.host = host;
+	address.port = port;
+	if (host.compare(0, 5, "unix:") == 0) {
+		address.kind = UNIX;
+		address.path = host.substr(5);
+	} else if (host.compare(0, 4, "shm:") == 0) {
+		address.kind = SHM;
+		address.path = host.substr(4);
+	}
+	return address;
+}
+
+std::string backend_address::toString() const {
+	switch (kind) {
+	case UNIX:
+		return "unix:" + path;
+	case SHM:
+		return "shm:" + path;
+	default:
+		return str(boost::format("%1%:%2%") % host % port);
+	}
+}
+
+boost::shared_ptr<backend_stream> backend_stream::connect(boost::asio::io_service& io_service, io_engine& engine,
+		const backend_address& address, boost::system::error_code& ec) {
+	int fd = -1;
+	if (address.kind == backend_address::SHM) {
+		boost::shared_ptr<shm_backend_stream> stream(new shm_backend_stream(engine));
+		stream->connect(address.path, ec);
+		if (ec) {
+			return boost::shared_ptr<backend_stream>();
+		}
+		return stream;
+	} else if (address.kind == backend_address::UNIX) {
+		boost::asio::local::stream_protocol::socket socket(io_service);
+		socket.connect(boost::asio::local::stream_protocol::endpoint(address.path), ec);
+		if (ec) {
+			return boost::shared_ptr<backend_stream>();
+		}
+		fd = socket.release(ec);
+	} else {
+		tcp::resolver resolver(io_service);
+		tcp::resolver::query query(address.host, boost::lexical_cast<std::string>(address.port));
+		tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, ec);
+		if (ec) {
+			return boost::shared_ptr<backend_stream>();
+		}
+		tcp::socket socket(io_service);
+		boost::asio::connect(socket, endpoint_iterator, ec);
+		if (ec) {
+			return boost::shared_ptr<backend_stream>();
+		}
+		socket.set_option(tcp::no_delay(true), ec);
+		fd = socket.release(ec);
+	}
+	if (ec) {
+		return boost::shared_ptr<backend_stream>();
+	}
+	return boost::shared_ptr<backend_stream>(new socket_backend_stream(engine, fd));
+}
+
+backend_stream::backend_stream() :
+		pausedFor(0) {
+}
+
+void backend_stream::pauseReads(pause_reason reason) {
+	bool reading = this->pausedFor == 0;
+	this->pausedFor |= reason;
+	if (reading) {
+		this->stopReading();
+	}
+}
+
+void backend_stream::resumeReads(pause_reason reason) {
+	if ((this->pausedFor & reason) == 0) {
+		return;
+	}
+	this->pausedFor &= ~(unsigned int) reason;
+	if (this->pausedFor == 0) {
+		this->startReading();
+	}
+}
+
+bool backend_stream::isPaused() {
+	return this->pausedFor != 0;
+}
+
+backend_stream::~backend_stream() {
+}
+
+socket_backend_stream::socket_backend_stream(io_engine& engine, int fd) :
+		engine(engine), fd(fd), open(false), started(false) {
+}
+
+void socket_backend_stream::start(data_handler handler) {
+	this->handler = handler;
+	this->open = true;
+	this->started = true;
+	// the engine never calls back for an unwatched descriptor, so the raw
+	// this stays valid: close() unwatches before the stream goes away.
+	engine.watch(fd, boost::bind(&socket_backend_stream::handleRead, this, _1, _2, _3, _4));
+	if (this->isPaused()) {
+		engine.pauseReads(fd);
+	}
+}
+
+void socket_backend_stream::handleRead(int, const unsigned char* data, std::size_t len, const boost::system::error_code& ec) {
+	// the handler may drop the last reference.
+	boost::shared_ptr<backend_stream> self = shared_from_this();
+	if (ec) {
+		// the engine unwatches the descriptor after this.
+		this->open = false;
+	}
+	handler(data, len, ec);
+}
+
+void socket_backend_stream::write(const unsigned char* data, std::size_t len) {
+	if (this->open) {
+		engine.write(fd, data, len);
+	}
+}
+
+bool socket_backend_stream::isFlushed() {
+	return !this->open || engine.getQueuedBytes(fd) == 0;
+}
+
+void socket_backend_stream::close() {
+	if (!this->open) {
+		return;
+	}
+	this->open = false;
+	engine.unwatch(fd);
+}
+
+int socket_backend_stream::handOver(boost::function<void()> released) {
+	if (!this->open) {
+		return -1;
+	}
+	this->open = false;
+	engine.release(fd, released);
+	return fd;
+}
+
+std::size_t socket_backend_stream::getQueuedBytes() {
+	return this->open ? engine.getQueuedBytes(fd) : 0;
+}
+
+void socket_backend_stream::stopReading() {
+	if (this->open) {
+		engine.pauseReads(fd);
+	}
+}
+
+void socket_backend_stream::startReading() {
+	if (this->open) {
+		engine.resumeReads(fd);
+	}
+}
+
+socket_backend_stream::~socket_backend_stream() {
+	this->close();
+	if (!this->started) {
+		::close(fd);
+	}
+}
+
+} /* namespace rtunnel */
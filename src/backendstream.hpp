@@ -0,0 +1,141 @@
+/*
+ * backendstream.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef BACKENDSTREAM_HPP_
+#define BACKENDSTREAM_HPP_
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/smart_ptr.hpp>
+#include "ioengine.hpp"
+#include "memorygovernor.hpp"
+#include "timerwheel.hpp"
+#include "tokenbucket.hpp"
+
+namespace rtunnel {
+
+/**
+ * where a mapping's connections go, parsed from tcpHost:
+ *
+ *   127.0.0.1          tcp to tcpHost:tcpPort
+ *   unix:/run/app.sock unix domain stream socket, tcpPort unused
+ *   shm:/run/app.sock  shared memory rings set up over the unix socket,
+ *                      see shm_backend_stream
+ */
+struct backend_address {
+	enum transport {
+		TCP, UNIX, SHM
+	};
+	transport kind;
+	std::string host;
+	int port;
+	std::string path;
+
+	static backend_address parse(const std::string& host, int port);
+	std::string toString() const;
+};
+
+/**
+ * one connection to the backend, carrying one tunneled stream.
+ *
+ * Runs on the io engine thread. The data handler gets what the backend
+ * sends; a call with an error code (eof included) is the last one, the
+ * stream is closed by then. close() drops whatever is not written yet, so
+ * callers wait for isFlushed() first when the backend should get it all.
+ *
+ * rateLimit caps what is read from the backend; while it is in debt reads
+ * are paused and rateTimer resumes them.
+ *
+ * Reads are paused for several reasons at once, each resumed on its own;
+ * reading goes on once none is left.
+ */
+class backend_stream: public boost::enable_shared_from_this<backend_stream> {
+public:
+	typedef boost::function<void(const unsigned char* data, std::size_t len, const boost::system::error_code& ec)> data_handler;
+
+	enum pause_reason {
+		// over the stream or mapping rate
+		PAUSE_RATE = 1,
+		// the tunnel writer is congested
+		PAUSE_CONGESTION = 2,
+		// the tunnel is being handed over
+		PAUSE_HANDOFF = 4,
+		// closed by the transit server, only draining
+		PAUSE_CLOSING = 8
+	};
+
+	/**
+	 * blocking connect, the backend is expected on this host. Meant for a
+	 * thread of its own with its own io_service: the stream only touches
+	 * engine once started.
+	 */
+	static boost::shared_ptr<backend_stream> connect(boost::asio::io_service& io_service, io_engine& engine,
+			const backend_address& address, boost::system::error_code& ec);
+
+	virtual void start(data_handler handler) = 0;
+	virtual void write(const unsigned char* data, std::size_t len) = 0;
+	virtual bool isFlushed() = 0;
+	virtual void close() = 0;
+	/**
+	 * stop serving the connection here but leave it open, to pass it to
+	 * another process; see io_engine::release().
+	 *
+	 * @return the descriptor, or -1 if this kind of stream can not be
+	 *         handed over.
+	 */
+	virtual int handOver(boost::function<void()> released) = 0;
+	/**
+	 * @return bytes from the tunnel not handed to the backend yet.
+	 */
+	virtual std::size_t getQueuedBytes() = 0;
+	void pauseReads(pause_reason reason);
+	void resumeReads(pause_reason reason);
+	bool isPaused();
+	virtual ~backend_stream();
+
+	rtunnel::token_bucket rateLimit;
+	rtunnel::wheel_timer rateTimer;
+protected:
+	backend_stream();
+
+	virtual void stopReading() = 0;
+	virtual void startReading() = 0;
+private:
+	unsigned int pausedFor;
+};
+
+/**
+ * tcp or unix domain socket, driven by the io engine.
+ */
+class socket_backend_stream: public backend_stream {
+public:
+	socket_backend_stream(io_engine& engine, int fd);
+
+	void start(data_handler handler);
+	void write(const unsigned char* data, std::size_t len);
+	bool isFlushed();
+	void close();
+	int handOver(boost::function<void()> released);
+	std::size_t getQueuedBytes();
+
+	virtual ~socket_backend_stream();
+protected:
+	void stopReading();
+	void startReading();
+private:
+	io_engine& engine;
+	int fd;
+	bool open;
+	bool started;
+	data_handler handler;
+
+	void handleRead(int fd, const unsigned char* data, std::size_t len, const boost::system::error_code& ec);
+};
+
+} /* namespace rtunnel */
+#endif /* BACKENDSTREAM_HPP_ */
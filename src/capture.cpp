@@ -0,0 +1,147 @@
+/*
+ * capture.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "capture.hpp"
+#include "controlschema.hpp"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rtunnel {
+
+log4cpp::Category& frame_capture::logger = log4cpp::Category::getInstance(std::string("rtunnel.frame_capture"));
+
+const boost::uint32_t frame_capture::MAGIC = 0x52544346;
+const boost::uint32_t frame_capture::FORMAT_VERSION = 1;
+const std::size_t frame_capture::FILE_HEADER_SIZE = 8;
+const std::size_t frame_capture::RECORD_HEADER_SIZE = 13;
+const std::size_t frame_capture::FLUSH_SIZE = 256 * 1024;
+
+frame_capture::frame_capture() :
+		fd(-1), frames(0), bytes(0) {
+}
+
+void frame_capture::open(const std::string& path, boost::system::error_code& ec) {
+	boost::mutex::scoped_lock lock(mutex);
+	int f = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (f < 0) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		return;
+	}
+	struct stat st;
+	if (fstat(f, &st) < 0) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		::close(f);
+		return;
+	}
+	if (st.st_size > 0) {
+		// appending to an earlier capture, which must be one.
+		unsigned char header[8];
+		if (pread(f, header, sizeof(header), 0) != (ssize_t) sizeof(header)
+				|| schema::big_endian<boost::uint32_t>::load(header) != MAGIC
+				|| schema::big_endian<boost::uint32_t>::load(header + 4) != FORMAT_VERSION) {
+			ec = boost::asio::error::invalid_argument;
+			::close(f);
+			return;
+		}
+	}
+	this->fd = f;
+	this->path = path;
+	this->buffer.reserve(FLUSH_SIZE + 65536);
+	if (st.st_size == 0) {
+		this->buffer.resize(FILE_HEADER_SIZE);
+		schema::big_endian<boost::uint32_t>::store(&buffer[0], MAGIC);
+		schema::big_endian<boost::uint32_t>::store(&buffer[4], FORMAT_VERSION);
+	}
+}
+
+bool frame_capture::isOpen() {
+	boost::mutex::scoped_lock lock(mutex);
+	return fd >= 0;
+}
+
+void frame_capture::record(int direction, int path, packet& p) {
+	boost::asio::const_buffer frame = p.wrapPacket();
+	const unsigned char* data = boost::asio::buffer_cast<const unsigned char*>(frame);
+	std::size_t len = boost::asio::buffer_size(frame);
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	boost::uint64_t now = (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds();
+
+	boost::mutex::scoped_lock lock(mutex);
+	if (fd < 0) {
+		return;
+	}
+	std::size_t at = buffer.size();
+	buffer.resize(at + RECORD_HEADER_SIZE);
+	schema::big_endian<boost::uint64_t>::store(&buffer[at], now);
+	buffer[at + 8] = (unsigned char) ((direction << 7) | (path & 0x7f));
+	schema::big_endian<boost::uint32_t>::store(&buffer[at + 9], streamOf(p.getProtocol(), data + 5, len - 5));
+	buffer.insert(buffer.end(), data, data + len);
+	frames++;
+	bytes += len;
+	if (buffer.size() >= FLUSH_SIZE) {
+		flushLocked();
+	}
+}
+
+void frame_capture::flush() {
+	boost::mutex::scoped_lock lock(mutex);
+	flushLocked();
+}
+
+/**
+ * a capture that can not be written any more is given up, the tunnel
+ * carries on without it.
+ */
+void frame_capture::flushLocked() {
+	std::size_t offset = 0;
+	while (fd >= 0 && offset < buffer.size()) {
+		ssize_t n = ::write(fd, &buffer[offset], buffer.size() - offset);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			frame_capture::logger.error(str(boost::format("writing capture %1% fails: %2%, capture stopped.") % path % strerror(errno)));
+			::close(fd);
+			fd = -1;
+			break;
+		}
+		offset += n;
+	}
+	buffer.clear();
+}
+
+void frame_capture::close() {
+	boost::mutex::scoped_lock lock(mutex);
+	flushLocked();
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+}
+
+std::string frame_capture::toString() {
+	boost::mutex::scoped_lock lock(mutex);
+	return str(boost::format("frames=%1%, bytes=%2%, file=%3%") % frames % bytes % path);
+}
+
+unsigned int frame_capture::streamOf(int protocol, const unsigned char* data, std::size_t len) {
+	if ((protocol == packet::DATA || protocol == packet::NEW_TCP_SOCKET || protocol == packet::ACK_NEW_TCP_SOCKET) && len >= 4) {
+		return schema::big_endian<unsigned int>::load(data);
+	}
+	return 0;
+}
+
+frame_capture::~frame_capture() {
+	close();
+}
+
+} /* namespace rtunnel */
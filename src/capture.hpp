@@ -0,0 +1,73 @@
+/*
+ * capture.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef CAPTURE_HPP_
+#define CAPTURE_HPP_
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <log4cpp/Category.hh>
+#include "packet.hpp"
+
+namespace rtunnel {
+
+/**
+ * appends every tunnel frame sent and received to a capture file, which
+ * frame_replay plays back offline.
+ *
+ * The file starts with magic and version as big endian u32. Each record
+ * is the time in microseconds since the epoch (u64), the direction in
+ * the high bit and the path index in the low 7 bits of one byte, the
+ * stream id (u32, 0 for frames without one), then the frame as it goes
+ * over the wire: type, data length and data.
+ */
+class frame_capture {
+public:
+	static const boost::uint32_t MAGIC;
+	static const boost::uint32_t FORMAT_VERSION;
+	static const std::size_t FILE_HEADER_SIZE;
+	static const std::size_t RECORD_HEADER_SIZE;
+	static const int INBOUND = 0;
+	static const int OUTBOUND = 1;
+
+	frame_capture();
+	/**
+	 * open path for appending, writing the file header if it is empty.
+	 */
+	void open(const std::string& path, boost::system::error_code& ec);
+	bool isOpen();
+	void record(int direction, int path, packet& p);
+	void flush();
+	void close();
+	std::string toString();
+
+	/**
+	 * the stream a frame belongs to, 0 if it does not carry one.
+	 */
+	static unsigned int streamOf(int protocol, const unsigned char* data, std::size_t len);
+
+	virtual ~frame_capture();
+private:
+	static const std::size_t FLUSH_SIZE;
+	static log4cpp::Category& logger;
+
+	// the tunnel writer takes packets from any thread.
+	boost::mutex mutex;
+	int fd;
+	std::string path;
+	std::vector<unsigned char> buffer;
+	unsigned long frames;
+	unsigned long long bytes;
+
+	void flushLocked();
+};
+
+} /* namespace rtunnel */
+#endif /* CAPTURE_HPP_ */
@@ -6,45 +6,1295 @@
  */
 
 #include "clientbootstrap.hpp"
+#include "crc32c.hpp"
+#include "probes.hpp"
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 #include <string>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace rtunnel {
 
 log4cpp::Category& client_bootstrap::logger = log4cpp::Category::getInstance(std::string("rtunnel.client_bootstrap"));
 
-client_bootstrap::client_bootstrap(int ac, char* av[]):mainKeepRunning(false), keepRunning(false), clientConfig() {
+client_bootstrap::client_bootstrap(int ac, char* av[]):mainKeepRunning(false), keepRunning(false), clientConfig(), currentPath(NULL), session(0), governorTicks(0), pathTicks(0), packetPool(16384, 256), timerWheel(10), handoffListenFd(-1), handoffRequest(-1), handoffFd(-1), handoffStreamsPaused(false), handoffFrozen(false), handoffTicks(0), handoffReleases(0), capturing(false), wheelTimer(io_service) {
 	clientConfig.init(ac, av);
+	this->backendAddress = backend_address::parse(this->clientConfig.tcpHost, this->clientConfig.tcpPort);
+	memory_governor::instance().setBudget((std::size_t)this->clientConfig.memoryBudget * 1024);
+	// a second's worth may go at once.
+	this->mappingBytes.setRate(this->clientConfig.rateLimit * 1024.0, this->clientConfig.rateLimit * 1024.0);
+	this->mappingStreams.setRate(this->clientConfig.acceptRate, std::max(1.0, this->clientConfig.acceptRate));
+	for(std::size_t i = 0; i < this->clientConfig.transitServers.size(); i++){
+		boost::shared_ptr<rtunnel::tunnel_path> path(new rtunnel::tunnel_path((int)i, this->clientConfig.transitServers[i].first, this->clientConfig.transitServers[i].second));
+		path->heartbeatTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::sendHeartBeat, this, path.get()));
+		path->idleTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::handleIdle, this, path.get()));
+		this->paths.push_back(path);
+	}
+	this->governorTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::enforceMemory, this));
+	this->pathTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::evaluatePaths, this));
+	this->handoffTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::checkHandoff, this));
 }
 
 void client_bootstrap::start(){
 	this->mainKeepRunning = true;
+	if(!this->clientConfig.captureFile.empty()){
+		boost::system::error_code ec;
+		this->capture.open(this->clientConfig.captureFile, ec);
+		if(ec){
+			client_bootstrap::logger.error(str(boost::format("can not capture to %1%: %2%") % this->clientConfig.captureFile % ec.message()));
+		}else{
+			this->capturing = true;
+			client_bootstrap::logger.info(str(boost::format("capturing tunnel frames to %1%.") % this->clientConfig.captureFile));
+		}
+	}
+	if(this->clientConfig.takeover){
+		this->takeOver();
+	}
+	this->connectWork = boost::shared_ptr<boost::asio::io_service::work>(new boost::asio::io_service::work(this->connectService));
+	for(int i = 0; i < CONNECT_THREADS; i++){
+		this->connectThreads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&rtunnel::client_bootstrap::runConnector, this))));
+	}
+	if(!this->clientConfig.handoffPath.empty()){
+		if(this->clientConfig.tunnelTransport == "udp"){
+			client_bootstrap::logger.warn("the udp tunnel can not be handed over, handoffPath is not served.");
+		}else{
+			boost::system::error_code ec;
+			this->handoffListenFd = handoff_state::listen(this->clientConfig.handoffPath, ec);
+			if(ec){
+				client_bootstrap::logger.error(str(boost::format("can not serve handoffs on %1%: %2%") % this->clientConfig.handoffPath % ec.message()));
+			}else{
+				this->handoffThread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&rtunnel::client_bootstrap::serveHandoffs, this)));
+			}
+		}
+	}
 	while(this->mainKeepRunning){
 		this->p_clientLogicThread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&rtunnel::client_bootstrap::runClientLogic, this)));
 		try{
 			this->p_clientLogicThread->join();
-			boost::this_thread::sleep(boost::posix_time::seconds(5));
+			// not after a handoff, the process is done.
+			if(this->mainKeepRunning){
+				boost::this_thread::sleep(boost::posix_time::seconds(5));
+			}
 		} catch(boost::thread_exception & e){
 			client_bootstrap::logger.debug("thread join error.");
 		}
 	}
 }
 
+/**
+ * blocking connect to a transit server, giving up after 5 seconds.
+ *
+ * @return the connected descriptor, -1 on error.
+ */
+static int connectTransit(boost::asio::io_service& io_service, const std::string& host, int port, boost::system::error_code& ec){
+	tcp::resolver resolver(io_service);
+	tcp::resolver::query query(host, boost::lexical_cast<std::string>(port));
+	tcp::resolver::iterator endpoint_iterator = resolver.resolve(query, ec);
+	if(ec){
+		return -1;
+	}
+	tcp::socket socket(io_service);
+	ec = boost::asio::error::host_not_found;
+	for(; endpoint_iterator != tcp::resolver::iterator(); ++endpoint_iterator){
+		boost::system::error_code ignored;
+		socket.close(ignored);
+		socket.open(endpoint_iterator->endpoint().protocol(), ec);
+		if(ec){
+			continue;
+		}
+		// linux applies the send timeout to a blocking connect.
+		struct timeval timeout = {5, 0};
+		setsockopt(socket.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		socket.connect(endpoint_iterator->endpoint(), ec);
+		if(!ec){
+			timeout.tv_sec = 0;
+			setsockopt(socket.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+			return socket.release(ec);
+		}
+	}
+	return -1;
+}
+
+/**
+ * connect every transit server and run until the last path and backend
+ * stream is gone; paths that go down meanwhile reconnect on their own.
+ */
 void client_bootstrap::runClientLogic(){
 	this->keepRunning = true;
+	this->session++;
 	client_bootstrap::logger.info(str(boost::format("begin to establish tunnel with transit server(forwardPort=%1%).") % this->clientConfig.forwardPort));
-	tcp::resolver resolver(io_service);
-	tcp::resolver::query query(this->clientConfig.rtunnelServerHost, boost::lexical_cast<std::string>(this->clientConfig.rtunnelServerPort));
-	tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-	this->p_socket = boost::shared_ptr<tcp::socket>(new tcp::socket(io_service));
+	if(this->clientConfig.tunnelTransport == "udp"){
+		this->runUdpTunnel();
+		return;
+	}
+	// the previous engine gives its buffers back to the pool first.
+	this->retiredWriters.clear();
+	this->p_ioEngine.reset();
+	this->p_ioEngine = io_engine::create(this->clientConfig.ioEngine, io_service, packetPool);
+	if(this->takenOver.get() != NULL){
+		this->adoptHandoff(*this->takenOver);
+		this->takenOver.reset();
+	}
+	std::size_t up = 0;
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		if(this->paths[i]->isOpen() || this->connectPath(this->paths[i].get())){
+			up++;
+		}
+	}
+	if(up == 0){
+		client_bootstrap::logger.info("connect to transit server fails, will try to reestablish it.");
+		this->cleanup();
+		return;
+	}
+	client_bootstrap::logger.info(str(boost::format("tunnel established with %1% of %2% transit servers, using %3% io engine.")
+			% up % this->paths.size() % this->p_ioEngine->getName()));
+	this->p_ioEngine->setTicker(this->timerWheel.getTickMs(), boost::bind(&rtunnel::client_bootstrap::tickTimers, this));
+	this->startTimers();
+	this->p_ioEngine->run();
+	if(this->isHandingOff()){
+		client_bootstrap::logger.warn("tunnel closed during the handoff.");
+		::close(this->handoffFd);
+		this->handoffFd = -1;
+		this->handoffStreamsPaused = false;
+		this->handoffFrozen = false;
+		this->handoffTimer.cancel();
+		this->handoff.closeAll();
+	}
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		if(this->paths[i]->connectThread.get() != NULL){
+			this->paths[i]->connectThread->join();
+			this->paths[i]->connectThread.reset();
+		}
+		this->closePath(this->paths[i].get());
+		this->paths[i]->state = tunnel_path::DOWN;
+	}
+	this->retiredWriters.clear();
+	this->governorTimer.cancel();
+	this->pathTimer.cancel();
+	client_bootstrap::logger.info(str(boost::format("memory: %1%") % memory_governor::instance().toString()));
+	if(this->capturing){
+		this->capture.flush();
+		client_bootstrap::logger.info(str(boost::format("capture: %1%") % this->capture.toString()));
+	}
+	client_bootstrap::logger.info("tunnel closed, will try to reestablish it.");
+	this->cleanup();
+}
+
+bool client_bootstrap::connectPath(tunnel_path* path){
 	boost::system::error_code ec;
-	boost::asio::connect(*(this->p_socket.get()), endpoint_iterator, ec);
+	int fd = connectTransit(this->io_service, path->host, path->port, ec);
+	if(ec){
+		client_bootstrap::logger.info(str(boost::format("connect to transit server %1%:%2% fails: %3%") % path->host % path->port % ec.message()));
+		path->state = tunnel_path::DOWN;
+		return false;
+	}
+	this->openPath(path, fd);
+	this->requestModes(path);
+	return true;
+}
+
+/**
+ * connect a path that went down while the others keep running, on its own
+ * thread; the result is posted back to the engine thread.
+ */
+void client_bootstrap::reconnectPath(tunnel_path* path, int session, boost::shared_ptr<rtunnel::io_engine> engine){
+	boost::asio::io_service connectService;
+	boost::system::error_code ec;
+	int fd = connectTransit(connectService, path->host, path->port, ec);
+	if(ec){
+		engine->post(boost::bind(&rtunnel::client_bootstrap::connectFailed, this, path, session));
+	}else{
+		engine->post(boost::bind(&rtunnel::client_bootstrap::adoptPath, this, path, session, fd));
+	}
+}
+
+void client_bootstrap::adoptPath(tunnel_path* path, int session, int fd){
+	if(session != this->session || path->state != tunnel_path::CONNECTING || this->isHandingOff() || !this->mainKeepRunning){
+		::close(fd);
+		if(session == this->session && path->state == tunnel_path::CONNECTING){
+			path->state = tunnel_path::DOWN;
+		}
+		return;
+	}
+	client_bootstrap::logger.info(str(boost::format("transit server %1%:%2% is back.") % path->host % path->port));
+	RTUNNEL_PROBE2(path_reconnect, path->index, 1);
+	this->openPath(path, fd);
+	this->requestModes(path);
+}
+
+void client_bootstrap::connectFailed(tunnel_path* path, int session){
+	RTUNNEL_PROBE2(path_reconnect, path->index, 0);
+	if(session == this->session && path->state == tunnel_path::CONNECTING){
+		path->state = tunnel_path::DOWN;
+	}
+}
+
+void client_bootstrap::openPath(tunnel_path* path, int fd){
+	memory_governor::instance().credit(path->inbound.size());
+	path->inbound.clear();
+	path->fd = fd;
+	path->engine = this->p_ioEngine.get();
+	path->srtt = -1;
+	path->heartbeatSentUs = -1;
+	path->downTicks = 0;
+	// a new descriptor is read from the start.
+	path->pausedFor = 0;
+	this->p_ioEngine->watch(fd, boost::bind(&rtunnel::client_bootstrap::handleTunnelRead, this, path, _1, _2, _3, _4));
+	path->writer = boost::shared_ptr<rtunnel::tunnel_writer>(new rtunnel::tunnel_writer(*this->p_ioEngine, fd, 4096));
+	path->writer->setResumeHandler(boost::bind(&rtunnel::client_bootstrap::resumeBackendStreams, this, path));
+	memory_governor::instance().attach(path);
+	path->state = tunnel_path::UP;
+	// the first heart beat goes early, path selection needs an rtt.
+	this->timerWheel.arm(path->heartbeatTimer, std::min(1000, this->clientConfig.heartbeatInterval * 1000));
+	this->timerWheel.arm(path->idleTimer, this->clientConfig.idleTimeout * 1000);
+}
+
+/**
+ * take a path down with the streams it carries; the other paths go on.
+ */
+void client_bootstrap::closePath(tunnel_path* path){
+	if(!path->isOpen()){
+		return;
+	}
+	path->state = tunnel_path::DOWN;
+	memory_governor::instance().detach(path);
+	path->heartbeatTimer.cancel();
+	path->idleTimer.cancel();
+	this->closeBackendStreams(path);
+	if(path->writer.get() != NULL){
+		client_bootstrap::logger.info(str(boost::format("path %1% writer: %2% packets in %3% batches, %4% rejected.")
+				% path->index % path->writer->getWritten() % path->writer->getBatches() % path->writer->getRejected()));
+		// a drain may still be posted, it must find the writer alive.
+		path->writer->close();
+		this->retiredWriters.push_back(path->writer);
+		path->writer.reset();
+	}
+	if(path->fd >= 0){
+		this->p_ioEngine->unwatch(path->fd);
+		path->fd = -1;
+	}
+	if(path->udp.get() != NULL){
+		path->udp->close();
+	}
+	client_bootstrap::logger.info(str(boost::format("tunnel to %1%:%2% closed.") % path->host % path->port));
+}
+
+/**
+ * once a second: drain paths scoring far worse than the best one while
+ * another path is up, bring them back once they recover, and retry paths
+ * that are down every 5 seconds.
+ */
+void client_bootstrap::evaluatePaths(){
+	if(this->isHandingOff()){
+		this->timerWheel.arm(this->pathTimer, 1000);
+		return;
+	}
+	double best = -1;
+	int up = 0;
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		double score = path->getScore();
+		if(path->isOpen() && score >= 0 && (best < 0 || score < best)){
+			best = score;
+		}
+		if(path->state == tunnel_path::UP){
+			up++;
+		}
+	}
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		if(path->state == tunnel_path::DOWN){
+			if(path->udp.get() == NULL && ++path->downTicks % 5 == 0){
+				if(path->connectThread.get() != NULL){
+					path->connectThread->join();
+				}
+				path->state = tunnel_path::CONNECTING;
+				path->connectThread = boost::shared_ptr<boost::thread>(new boost::thread(
+						boost::bind(&rtunnel::client_bootstrap::reconnectPath, this, path, this->session, this->p_ioEngine)));
+			}
+			continue;
+		}
+		double score = path->getScore();
+		bool congested = path->isCongested();
+		if(path->state == tunnel_path::UP && up > 1 && ((score >= 0 && score > 2 * best + 20) || congested)){
+			client_bootstrap::logger.info(str(boost::format("%1% degraded (best score %2%), draining.") % path->toString() % best));
+			path->state = tunnel_path::DRAINING;
+			up--;
+		}else if(path->state == tunnel_path::DRAINING && !congested && (up == 0 || (score >= 0 && score <= 1.5 * best + 10))){
+			client_bootstrap::logger.info(str(boost::format("%1% recovered.") % path->toString()));
+			path->state = tunnel_path::UP;
+			up++;
+		}
+	}
+	this->reapRetiredWriters();
+	if(++this->pathTicks % 60 == 0){
+		for(std::size_t i = 0; i < this->paths.size(); i++){
+			client_bootstrap::logger.info(this->paths[i]->toString());
+		}
+	}
+	this->timerWheel.arm(this->pathTimer, 1000);
+}
+
+void client_bootstrap::reapRetiredWriters(){
+	for(std::size_t i = 0; i < this->retiredWriters.size();){
+		if(this->retiredWriters[i]->isIdle()){
+			this->retiredWriters.erase(this->retiredWriters.begin() + i);
+		}else{
+			i++;
+		}
+	}
+}
+
+/**
+ * cut complete packet frames out of the bytes read from the tunnel.
+ */
+void client_bootstrap::handleTunnelRead(tunnel_path* path, int, const unsigned char* data, std::size_t len, const boost::system::error_code& ec){
+	if(ec){
+		client_bootstrap::logger.info(str(boost::format("tunnel read error from %1%:%2%: %3%") % path->host % path->port % ec.message()));
+		this->closePath(path);
+		return;
+	}
+	path->inbound.insert(path->inbound.end(), data, data + len);
+	memory_governor::instance().charge(len);
+	// once frozen for a handoff, the new process parses it.
+	if(!this->handoffFrozen){
+		this->parseFrames(path);
+	}
+}
+
+void client_bootstrap::parseFrames(tunnel_path* path){
+	std::size_t offset = 0;
+	while(path->isOpen() && path->inbound.size() - offset >= 5){
+		const unsigned char* head = &path->inbound[offset];
+		unsigned int dataLen = ((unsigned int)head[1] << 24) | ((unsigned int)head[2] << 16) | ((unsigned int)head[3] << 8) | (unsigned int)head[4];
+		// judge the length before waiting for that many bytes.
+		unsigned int trailer = (head[0] & packet::CHECKSUMMED) ? 4 : 0;
+		if(dataLen >= (unsigned int)packet::PACKET_MAX_SIZE + trailer){
+			path->corruptFrames++;
+			client_bootstrap::logger.error(str(boost::format("%1% byte frame, closing %2%.") % dataLen % path->toString()));
+			this->closePath(path);
+			break;
+		}
+		if(path->inbound.size() - offset < 5 + (std::size_t)dataLen){
+			break;
+		}
+		// readPacket() makes room for the trailer.
+		packet p(std::min(dataLen, (unsigned int)packet::PACKET_MAX_SIZE - 1));
+		p.readPacket(std::vector<unsigned char>(path->inbound.begin() + offset, path->inbound.begin() + offset + 5 + dataLen), 5 + dataLen);
+		offset += 5 + dataLen;
+		this->handleTunnelPacket(path, p);
+	}
+	if(!path->isOpen()){
+		// nothing after a bad frame can be trusted.
+		offset = path->inbound.size();
+	}
+	path->inbound.erase(path->inbound.begin(), path->inbound.begin() + offset);
+	memory_governor::instance().credit(offset);
+}
+
+void client_bootstrap::handleTunnelPacket(tunnel_path* path, packet& p){
+	// re-armed on every packet, which the timer wheel makes a list splice.
+	if(this->capturing){
+		this->capture.record(frame_capture::INBOUND, path->index, p);
+	}
+	if(p.isChecksummed() && path->frameChecksum){
+		path->checksumRequired = true;
+	}else if(path->checksumRequired){
+		// a flipped flag bit, or a stray frame; its checksum can not be checked.
+		path->corruptFrames++;
+		client_bootstrap::logger.error(str(boost::format("frame without checksum, closing %1%.") % path->toString()));
+		this->closePath(path);
+		return;
+	}
+	if(!p.decode()){
+		// the frame boundaries may be off from here on, start over.
+		path->corruptFrames++;
+		client_bootstrap::logger.error(str(boost::format("frame checksum mismatch, closing %1%.") % path->toString()));
+		this->closePath(path);
+		return;
+	}
+	RTUNNEL_PROBE4(frame_receive, path->index, p.getType(), p.getDataLen(), frame_capture::streamOf(p.getProtocol(), p.dataAt(0), p.getDataLen()));
+	this->timerWheel.arm(path->idleTimer, this->clientConfig.idleTimeout * 1000);
+	this->currentPath = path;
+	control_dispatcher<client_bootstrap>::dispatch(*this, p);
+	this->currentPath = NULL;
+}
+
+/**
+ * reply on the path the packet being dispatched came from.
+ */
+template<typename Message>
+void client_bootstrap::sendControl(const Message& m){
+	this->sendControl(this->currentPath, m);
+}
+
+template<typename Message>
+void client_bootstrap::sendControl(tunnel_path* path, const Message& m){
+	packet* p = this->obtainPacket(path, Message::layout::SIZE);
+	schema::encode(*p, m);
+	this->sendPacket(path, p);
+}
+
+/**
+ * ask a newly connected path for the optional modes configured. Frames say
+ * themselves whether they are checksummed, so ours are sealed once the
+ * ack grants it and either side may start before the other. A path handed
+ * over keeps the modes it had.
+ */
+void client_bootstrap::requestModes(tunnel_path* path){
+	path->frameChecksum = false;
+	path->checksumRequired = false;
+	if(this->clientConfig.frameChecksum){
+		tunnel_mode_message mode;
+		mode.mode = tunnel_mode_message::FRAME_CHECKSUM;
+		this->sendControl(path, mode);
+	}
+}
+
+packet* client_bootstrap::obtainPacket(tunnel_path* path, int size){
+	if(path->writer.get() != NULL){
+		return path->writer->obtain(size);
+	}
+	return new packet(size);
+}
+
+/**
+ * send p through the path's tunnel, taking ownership of it. Control frames
+ * and stream closes may use the writer's reserve, stream data may not.
+ *
+ * @return false if the send queue was full and p is dropped.
+ */
+bool client_bootstrap::sendPacket(tunnel_path* path, packet* p){
+	bool control = !p->isProtocol(packet::DATA) || p->getDataLen() <= 4;
+	if(path->frameChecksum){
+		p->appendChecksum();
+	}
+	RTUNNEL_PROBE4(frame_send, path->index, p->getType(), p->getDataLen(), frame_capture::streamOf(p->getProtocol(), p->dataAt(0), p->getDataLen()));
+	if(this->capturing){
+		this->capture.record(frame_capture::OUTBOUND, path->index, *p);
+	}
+	if(path->writer.get() != NULL){
+		if(!(control ? path->writer->offerControl(p) : path->writer->offer(p))){
+			client_bootstrap::logger.warn(str(boost::format("tunnel send queue of path %1% full, packet dropped.") % path->index));
+			path->writer->recycle(p);
+			return false;
+		}
+		return true;
+	}
+	if(path->udp.get() != NULL){
+		path->udp->send(*p);
+	}
+	delete p;
+	return true;
+}
+
+/**
+ * all tunnel timeouts live on timerWheel, which one timer per tunnel
+ * thread drives: the io engine's ticker for tcp, wheelTimer for udp.
+ */
+void client_bootstrap::startTimers(){
+	this->timerWheel.arm(this->governorTimer, 100);
+	this->timerWheel.arm(this->pathTimer, 1000);
+}
+
+void client_bootstrap::tickTimers(){
+	this->timerWheel.advance();
+	if(this->handoffRequest.load(boost::memory_order_relaxed) >= 0 && !this->isHandingOff()){
+		int fd = this->handoffRequest.exchange(-1);
+		if(fd >= 0){
+			this->beginHandoff(fd);
+		}
+	}
+}
+
+void client_bootstrap::handleWheelTimer(const boost::system::error_code& ec){
+	if(ec){
+		return;
+	}
+	this->timerWheel.advance();
+	this->wheelTimer.expires_from_now(boost::posix_time::milliseconds(this->timerWheel.getTickMs()));
+	this->wheelTimer.async_wait(boost::bind(&rtunnel::client_bootstrap::handleWheelTimer, this, boost::asio::placeholders::error));
+}
+
+void client_bootstrap::handleUdpClosed(tunnel_path* path, const boost::system::error_code&){
+	// lets io_service.run() return.
+	this->wheelTimer.cancel();
+	this->closePath(path);
+}
+
+void client_bootstrap::sendHeartBeat(tunnel_path* path){
+	packet* p = this->obtainPacket(path, 8);
+	packet::fillHeartBeatPacket(*p);
+	heart_beat_message sent;
+	schema::decode(*p, sent);
+	path->heartbeatTime = sent.time;
+	path->heartbeatSentUs = token_bucket::now();
+	this->sendPacket(path, p);
+	this->timerWheel.arm(path->heartbeatTimer, this->clientConfig.heartbeatInterval * 1000);
+}
+
+void client_bootstrap::handleIdle(tunnel_path* path){
+	client_bootstrap::logger.info(str(boost::format("nothing received from transit server %1%:%2% for %3% seconds, closing the tunnel.")
+			% path->host % path->port % this->clientConfig.idleTimeout));
+	this->closePath(path);
+}
+
+/**
+ * let the governor pause or resume streams every 100ms; report the usage
+ * once a minute.
+ */
+void client_bootstrap::enforceMemory(){
+	// a handoff pauses everything itself.
+	if(!this->isHandingOff()){
+		memory_governor::instance().enforce();
+	}
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		this->reapLingeringStreams(this->paths[i].get());
+	}
+	if(this->capturing && this->governorTicks % 10 == 0){
+		// a crash loses a second of capture at most.
+		this->capture.flush();
+	}
+	if(++this->governorTicks % 600 == 0){
+		client_bootstrap::logger.info(str(boost::format("memory: %1%") % memory_governor::instance().toString()));
+	}
+	this->timerWheel.arm(this->governorTimer, 100);
+}
+
+void client_bootstrap::onControl(const heart_beat_message& m, packet&){
+	ack_heart_beat_message ack;
+	ack.time = m.time;
+	this->sendControl(ack);
+}
+
+/**
+ * the echoed time only tells which heart beat is acked; the rtt comes from
+ * the monotonic clock, which no wall clock step or midnight disturbs.
+ */
+void client_bootstrap::onControl(const ack_heart_beat_message& m, packet&){
+	tunnel_path* path = this->currentPath;
+	if(path->heartbeatSentUs < 0 || m.time != path->heartbeatTime){
+		client_bootstrap::logger.debug(str(boost::format("stale heart beat ack on path %1%.") % path->index));
+		return;
+	}
+	long long rtt = (token_bucket::now() - path->heartbeatSentUs) / 1000;
+	path->heartbeatSentUs = -1;
+	path->updateRtt(rtt);
+	RTUNNEL_PROBE2(heartbeat_rtt, path->index, rtt);
+	client_bootstrap::logger.debug(str(boost::format("heart beat rtt %1%ms on path %2%.") % rtt % path->index));
+}
+
+void client_bootstrap::onControl(const create_tcp_server_message& m, packet&){
+	client_bootstrap::logger.debug(str(boost::format("unexpected create tcp server for port %1%.") % m.port));
+}
+
+void client_bootstrap::onControl(const ack_create_tcp_server_message& m, packet&){
+	client_bootstrap::logger.info(str(boost::format("transit server created tcp server, result=%1%.") % m.result));
+}
+
+/**
+ * open the backend connection for a stream accepted by the transit server.
+ * A draining path refuses it, so the transit side can place the stream on
+ * a better path. The connect blocks, so it is queued for the connector
+ * threads and adoptBackendStream() acks the stream once it is done.
+ */
+void client_bootstrap::onControl(const new_tcp_socket_message& m, packet&){
+	tunnel_path* path = this->currentPath;
+	if(this->p_ioEngine.get() == NULL){
+		return;
+	}
+	RTUNNEL_PROBE2(stream_accept, path->index, m.stream);
+	ack_new_tcp_socket_message ack;
+	ack.stream = m.stream;
+	if(path->state == tunnel_path::DRAINING || this->isHandingOff()){
+		ack.result = RESULT_PATH_DRAINING;
+		path->refused++;
+		this->sendControl(ack);
+		return;
+	}
+	if(!this->mappingStreams.tryTake(1, token_bucket::now())){
+		client_bootstrap::logger.debug(str(boost::format("stream %1% refused, over %2% streams/s.") % m.stream % this->clientConfig.acceptRate));
+		ack.result = RESULT_RATE_LIMITED;
+		path->refused++;
+		this->sendControl(ack);
+		return;
+	}
+	this->closeBackendStream(path, m.stream);
+	tunnel_path::pending_stream& pending = path->connecting[m.stream];
+	pending.ticket = ++path->connects;
+	pending.closed = false;
+	this->connectService.post(boost::bind(&rtunnel::client_bootstrap::connectBackend, this, path, this->session, m.stream, pending.ticket, this->p_ioEngine));
+}
+
+void client_bootstrap::runConnector(){
+	boost::system::error_code ignored;
+	this->connectService.run(ignored);
+}
+
+/**
+ * runs on a connector thread, the sockets are made blocking on
+ * connectService and handed to the engine once connected.
+ */
+void client_bootstrap::connectBackend(tunnel_path* path, int session, unsigned int stream, unsigned long ticket, boost::shared_ptr<rtunnel::io_engine> engine){
+	boost::system::error_code ec;
+	boost::shared_ptr<rtunnel::backend_stream> s = backend_stream::connect(this->connectService, *engine, this->backendAddress, ec);
+	engine->post(boost::bind(&rtunnel::client_bootstrap::adoptBackendStream, this, path, session, stream, ticket, s, ec));
+}
+
+/**
+ * the backend connect is done: ack the stream, then pass on what the
+ * tunnel sent for it meanwhile. If the path or the stream closed in the
+ * meantime the connection is dropped unused.
+ */
+void client_bootstrap::adoptBackendStream(tunnel_path* path, int session, unsigned int stream, unsigned long ticket,
+		boost::shared_ptr<rtunnel::backend_stream> s, boost::system::error_code ec){
+	if(session != this->session){
+		return;
+	}
+	std::map<unsigned int, tunnel_path::pending_stream>::iterator it = path->connecting.find(stream);
+	if(it == path->connecting.end() || it->second.ticket != ticket){
+		return;
+	}
+	std::vector<unsigned char> held;
+	held.swap(it->second.data);
+	bool closed = it->second.closed;
+	path->connecting.erase(it);
+	memory_governor::instance().credit(held.size());
+	RTUNNEL_PROBE3(backend_connect, path->index, stream, ec.value());
+	ack_new_tcp_socket_message ack;
+	ack.stream = stream;
+	if(!ec && this->isHandingOff()){
+		// begun since the connect started, the stream could not go along.
+		ack.result = RESULT_PATH_DRAINING;
+		path->refused++;
+		this->sendControl(path, ack);
+		return;
+	}
+	ack.result = ec ? RESULT_BACKEND_FAILED : RESULT_OK;
+	this->sendControl(path, ack);
+	if(ec){
+		client_bootstrap::logger.warn(str(boost::format("connect to backend %1% for stream %2% fails: %3%") % this->backendAddress.toString() % stream % ec.message()));
+		return;
+	}
+	path->accepted++;
+	path->streams[stream] = s;
+	this->shapeStream(path, stream, s);
+	// after the ack: starting may deliver data already.
+	s->start(boost::bind(&rtunnel::client_bootstrap::handleBackendData, this, path, stream, _1, _2, _3));
+	if(!held.empty()){
+		s->write(&held[0], held.size());
+	}
+	if(closed){
+		this->closeBackendStream(path, stream);
+	}
+}
+
+void client_bootstrap::onControl(const ack_new_tcp_socket_message& m, packet&){
+	client_bootstrap::logger.debug(str(boost::format("unexpected ack new tcp socket for stream %1%.") % m.stream));
+}
+
+void client_bootstrap::onControl(const close_tunnel_message&, packet&){
+	client_bootstrap::logger.info(str(boost::format("transit server %1%:%2% closed the tunnel.") % this->currentPath->host % this->currentPath->port));
+	this->closePath(this->currentPath);
+}
+
+/**
+ * the transit server asks for modes, grant the configured ones.
+ */
+void client_bootstrap::onControl(const tunnel_mode_message& m, packet&){
+	client_bootstrap::logger.debug(str(boost::format("tunnel mode %1%.") % m.mode));
+	ack_tunnel_mode_message ack;
+	ack.mode = m.mode & (this->clientConfig.frameChecksum ? (unsigned int)tunnel_mode_message::FRAME_CHECKSUM : 0);
+	this->sendControl(ack);
+	if(ack.mode & tunnel_mode_message::FRAME_CHECKSUM){
+		this->currentPath->frameChecksum = true;
+	}
+}
+
+void client_bootstrap::onControl(const ack_tunnel_mode_message& m, packet&){
+	client_bootstrap::logger.debug(str(boost::format("ack tunnel mode %1%.") % m.mode));
+	if(this->clientConfig.frameChecksum && (m.mode & tunnel_mode_message::FRAME_CHECKSUM)){
+		this->currentPath->frameChecksum = true;
+		// it seals everything after the ack.
+		this->currentPath->checksumRequired = true;
+		client_bootstrap::logger.info(str(boost::format("frames on path %1% carry a crc32c (%2%).") % this->currentPath->index % crc32cImplementation()));
+	}else if(this->clientConfig.frameChecksum){
+		client_bootstrap::logger.info(str(boost::format("transit server %1%:%2% does not take checksummed frames.") % this->currentPath->host % this->currentPath->port));
+	}
+}
+
+/**
+ * DATA carries a stream id and the stream's bytes; no bytes means the
+ * stream is closed.
+ */
+void client_bootstrap::onPacket(packet& p){
+	if(p.isProtocol(packet::DATA)){
+		if(p.getDataLen() < 4){
+			this->onMalformed(p);
+			return;
+		}
+		tunnel_path* path = this->currentPath;
+		unsigned int stream = schema::big_endian<unsigned int>::load(p.dataAt(0));
+		std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.find(stream);
+		std::map<unsigned int, tunnel_path::pending_stream>::iterator pending = path->connecting.find(stream);
+		std::size_t backlog = 0;
+		if(pending != path->connecting.end()){
+			// adoptBackendStream() passes it on.
+			if(p.getDataLen() == 4){
+				pending->second.closed = true;
+			}else if(!pending->second.closed){
+				pending->second.data.insert(pending->second.data.end(), p.dataAt(4), p.dataAt(4) + p.getDataLen() - 4);
+				memory_governor::instance().charge(p.getDataLen() - 4);
+				backlog = pending->second.data.size();
+			}
+		}else if(it == path->streams.end()){
+			client_bootstrap::logger.debug(str(boost::format("data for unknown stream %1% dropped.") % stream));
+		}else if(p.getDataLen() == 4){
+			this->closeBackendStream(path, stream);
+		}else{
+			it->second->write(p.dataAt(4), p.getDataLen() - 4);
+			backlog = it->second->getQueuedBytes();
+		}
+		if(backlog >= MAX_BACKEND_BACKLOG){
+			// the tunnel can not stop for one stream without stopping the
+			// others, so a backend this far behind loses its stream.
+			this->resetStream(path, stream, str(boost::format("%1% bytes queued for its backend") % backlog));
+		}
+		return;
+	}
+	client_bootstrap::logger.debug(str(boost::format("received %1%") % p.toString()));
+}
+
+void client_bootstrap::handleBackendData(tunnel_path* path, unsigned int stream, const unsigned char* data, std::size_t len, const boost::system::error_code& ec){
+	if(this->handoffFrozen){
+		// read before the release took effect, the new process sends it.
+		std::map<std::pair<tunnel_path*, unsigned int>, std::size_t>::iterator h = this->handoffStreams.find(std::make_pair(path, stream));
+		if(h != this->handoffStreams.end() && !ec){
+			this->handoff.streams[h->second].outbound.insert(this->handoff.streams[h->second].outbound.end(), data, data + len);
+		}
+		return;
+	}
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.find(stream);
+	if(it == path->streams.end()){
+		// lingering after the transit server closed it.
+		return;
+	}
+	if(ec){
+		client_bootstrap::logger.debug(str(boost::format("backend closed stream %1%: %2%") % stream % ec.message()));
+		RTUNNEL_PROBE3(stream_close, path->index, stream, 1);
+		path->streams.erase(it);
+		this->sendData(path, stream, NULL, 0);
+		return;
+	}
+	if(!this->sendData(path, stream, data, len)){
+		return;
+	}
+	this->shapeBackendData(*it->second, len);
+	if(path->isCongested()){
+		// resumeBackendStreams() once the writer or the udp tunnel has drained.
+		it->second->pauseReads(backend_stream::PAUSE_CONGESTION);
+	}
+}
+
+/**
+ * @return false if the data could not be queued; the stream has been reset
+ *         then, a gap in it would corrupt what the other side reads.
+ */
+bool client_bootstrap::sendData(tunnel_path* path, unsigned int stream, const unsigned char* data, std::size_t len){
+	packet* p = this->obtainPacket(path, 4 + len);
+	p->setProtocol(packet::DATA);
+	unsigned char* out = p->reserveData(4 + len);
+	schema::big_endian<unsigned int>::store(out, stream);
+	if(len > 0){
+		memcpy(out + 4, data, len);
+	}
+	if(this->sendPacket(path, p) || len == 0){
+		return true;
+	}
+	this->resetStream(path, stream, "its data did not fit the send queue");
+	return false;
+}
+
+/**
+ * close the backend stream at once, or drop its connect, and tell the
+ * transit server, whose close goes through the writer's reserve.
+ */
+void client_bootstrap::resetStream(tunnel_path* path, unsigned int stream, const std::string& reason){
+	client_bootstrap::logger.warn(str(boost::format("resetting stream %1% of path %2%, %3%.") % stream % path->index % reason));
+	RTUNNEL_PROBE3(stream_close, path->index, stream, 2);
+	std::map<unsigned int, tunnel_path::pending_stream>::iterator pending = path->connecting.find(stream);
+	if(pending != path->connecting.end()){
+		memory_governor::instance().credit(pending->second.data.size());
+		path->connecting.erase(pending);
+	}
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.find(stream);
+	if(it != path->streams.end()){
+		boost::shared_ptr<rtunnel::backend_stream> s = it->second;
+		path->streams.erase(it);
+		s->close();
+	}
+	this->sendData(path, stream, NULL, 0);
+}
+
+void client_bootstrap::shapeStream(tunnel_path* path, unsigned int stream, boost::shared_ptr<rtunnel::backend_stream> s){
+	s->rateLimit.setRate(this->clientConfig.streamRateLimit * 1024.0, this->clientConfig.streamRateLimit * 1024.0);
+	s->rateTimer.setCallback(boost::bind(&rtunnel::client_bootstrap::resumeShapedStream, this, path, stream));
+}
+
+/**
+ * charge what was just read from s to its limits and the mapping's; reads
+ * pause until both are out of debt, no data is held back.
+ */
+void client_bootstrap::shapeBackendData(backend_stream& s, std::size_t len){
+	if(!this->mappingBytes.isLimited() && !s.rateLimit.isLimited()){
+		return;
+	}
+	long long now = token_bucket::now();
+	this->mappingBytes.consume(len, now);
+	s.rateLimit.consume(len, now);
+	int delay = std::max(this->mappingBytes.getDelayMs(now), s.rateLimit.getDelayMs(now));
+	if(delay > 0){
+		s.pauseReads(backend_stream::PAUSE_RATE);
+		this->timerWheel.arm(s.rateTimer, delay);
+	}
+}
+
+void client_bootstrap::resumeShapedStream(tunnel_path* path, unsigned int stream){
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.find(stream);
+	if(it != path->streams.end()){
+		it->second->resumeReads(backend_stream::PAUSE_RATE);
+	}
+}
+
+/**
+ * the transit server closed the stream: close the backend connection once
+ * what is queued for it has been written, at most 5 seconds later.
+ */
+void client_bootstrap::closeBackendStream(tunnel_path* path, unsigned int stream){
+	std::map<unsigned int, tunnel_path::pending_stream>::iterator pending = path->connecting.find(stream);
+	if(pending != path->connecting.end()){
+		// its connect finds it gone.
+		memory_governor::instance().credit(pending->second.data.size());
+		path->connecting.erase(pending);
+	}
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.find(stream);
+	if(it == path->streams.end()){
+		return;
+	}
+	RTUNNEL_PROBE3(stream_close, path->index, stream, 0);
+	boost::shared_ptr<rtunnel::backend_stream> s = it->second;
+	path->streams.erase(it);
+	if(s->isFlushed()){
+		s->close();
+	}else{
+		s->pauseReads(backend_stream::PAUSE_CLOSING);
+		path->lingeringStreams.push_back(std::make_pair(s, 0));
+	}
+}
+
+void client_bootstrap::reapLingeringStreams(tunnel_path* path){
+	for(std::size_t i = 0; i < path->lingeringStreams.size();){
+		if(path->lingeringStreams[i].first->isFlushed() || ++path->lingeringStreams[i].second > 50){
+			path->lingeringStreams[i].first->close();
+			path->lingeringStreams.erase(path->lingeringStreams.begin() + i);
+		}else{
+			i++;
+		}
+	}
+}
+
+void client_bootstrap::closeBackendStreams(tunnel_path* path){
+	for(std::map<unsigned int, tunnel_path::pending_stream>::iterator it = path->connecting.begin(); it != path->connecting.end(); ++it){
+		memory_governor::instance().credit(it->second.data.size());
+	}
+	path->connecting.clear();
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> > streams;
+	streams.swap(path->streams);
+	for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = streams.begin(); it != streams.end(); ++it){
+		it->second->close();
+	}
+	for(std::size_t i = 0; i < path->lingeringStreams.size(); i++){
+		path->lingeringStreams[i].first->close();
+	}
+	path->lingeringStreams.clear();
+}
+
+/**
+ * the writer has drained; streams paused for another reason as well stay
+ * paused until that is gone too.
+ */
+void client_bootstrap::resumeBackendStreams(tunnel_path* path){
+	for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.begin(); it != path->streams.end(); ++it){
+		it->second->resumeReads(backend_stream::PAUSE_CONGESTION);
+	}
+}
+
+void client_bootstrap::onMalformed(packet& p){
+	client_bootstrap::logger.warn(str(boost::format("malformed control packet %1%") % p.toString()));
+}
+
+/**
+ * accept the processes that want to take over, the engine thread picks
+ * them up in tickTimers().
+ */
+void client_bootstrap::serveHandoffs(){
+	while(true){
+		int fd = ::accept4(this->handoffListenFd, NULL, NULL, SOCK_CLOEXEC);
+		if(fd < 0){
+			if(errno == EINTR || errno == ECONNABORTED){
+				continue;
+			}
+			// shut down by stop().
+			return;
+		}
+		// the socket is ours only, but a successor also has to run as us.
+		struct ucred peer;
+		socklen_t len = sizeof(peer);
+		if(::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) != 0){
+			client_bootstrap::logger.warn(str(boost::format("handoff request refused, no peer credentials: %1%") % strerror(errno)));
+			::close(fd);
+			continue;
+		}
+		if(peer.uid != ::geteuid()){
+			client_bootstrap::logger.warn(str(boost::format("handoff request from uid %1% (pid %2%) refused.") % peer.uid % peer.pid));
+			::close(fd);
+			continue;
+		}
+		client_bootstrap::logger.info("handoff requested.");
+		int previous = this->handoffRequest.exchange(fd);
+		if(previous >= 0){
+			::close(previous);
+		}
+	}
+}
+
+/**
+ * get the live tunnel from the process serving handoffPath; without one
+ * this process starts a fresh tunnel.
+ */
+void client_bootstrap::takeOver(){
+	boost::system::error_code ec;
+	boost::shared_ptr<rtunnel::handoff_state> state(new rtunnel::handoff_state());
+	int fd = handoff_state::connect(this->clientConfig.handoffPath, ec);
+	if(!ec){
+		state->receive(fd, ec);
+		::close(fd);
+	}
+	if(ec){
+		client_bootstrap::logger.warn(str(boost::format("take over from %1% fails: %2%, starting a fresh tunnel.") % this->clientConfig.handoffPath % ec.message()));
+		return;
+	}
+	client_bootstrap::logger.info(str(boost::format("took over %1% from %2%.") % state->toString() % this->clientConfig.handoffPath));
+	this->takenOver = state;
+}
+
+bool client_bootstrap::isHandingOff(){
+	return this->handoffFd >= 0;
+}
+
+/**
+ * hand the tunnel to the process connected on fd: stop reading, wait for
+ * what is queued to be written, then pass the sockets over.
+ */
+void client_bootstrap::beginHandoff(int fd){
+	client_bootstrap::logger.info("handing the tunnel over, pausing tunnel reads.");
+	this->handoffFd = fd;
+	this->handoffTicks = 0;
+	this->handoffStreamsPaused = false;
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		if(!path->isOpen()){
+			continue;
+		}
+		path->pauseReads(tunnel_path::PAUSE_HANDOFF);
+		if(this->backendAddress.kind == backend_address::SHM && !path->streams.empty()){
+			// the ring positions live in this process' mapping, see
+			// shm_backend_stream::handOver().
+			client_bootstrap::logger.warn(str(boost::format("shared memory streams can not be handed over, closing the %1% of path %2%.") % path->streams.size() % path->index));
+			while(!path->streams.empty()){
+				unsigned int stream = path->streams.begin()->first;
+				this->closeBackendStream(path, stream);
+				this->sendData(path, stream, NULL, 0);
+			}
+		}
+	}
+	this->timerWheel.arm(this->handoffTimer, 10);
+}
+
+/**
+ * the backends are read until everything for them is written, so they do
+ * not stall on a full socket while this waits for them.
+ */
+void client_bootstrap::checkHandoff(){
+	if(!this->handoffStreamsPaused && this->isFlushed(false)){
+		for(std::size_t i = 0; i < this->paths.size(); i++){
+			for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = this->paths[i]->streams.begin(); it != this->paths[i]->streams.end(); ++it){
+				it->second->pauseReads(backend_stream::PAUSE_HANDOFF);
+			}
+		}
+		this->handoffStreamsPaused = true;
+	}
+	if(this->handoffStreamsPaused && this->isFlushed(true)){
+		this->freezeForHandoff();
+		return;
+	}
+	if(++this->handoffTicks > 300){
+		this->abortHandoff("the queues did not drain in 3 seconds");
+		return;
+	}
+	this->timerWheel.arm(this->handoffTimer, 10);
+}
+
+/**
+ * nothing left to write to the backends, and with tunnels set to the
+ * tunnels either.
+ */
+bool client_bootstrap::isFlushed(bool tunnels){
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		if(!path->isOpen()){
+			continue;
+		}
+		if(tunnels && (path->writer->getDepth() > 0 || !path->writer->isIdle() || this->p_ioEngine->getQueuedBytes(path->fd) > 0)){
+			return false;
+		}
+		// a connect still going acks its stream yet.
+		if(!path->connecting.empty()){
+			return false;
+		}
+		for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.begin(); it != path->streams.end(); ++it){
+			if(!it->second->isFlushed()){
+				return false;
+			}
+		}
+		for(std::size_t j = 0; j < path->lingeringStreams.size(); j++){
+			if(!path->lingeringStreams[j].first->isFlushed()){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void client_bootstrap::abortHandoff(const std::string& reason){
+	client_bootstrap::logger.warn(str(boost::format("handoff aborted: %1%.") % reason));
+	::close(this->handoffFd);
+	this->handoffFd = -1;
+	this->handoffStreamsPaused = false;
+	this->handoffTimer.cancel();
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		if(path->isOpen()){
+			path->resumeReads(tunnel_path::PAUSE_HANDOFF);
+			for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.begin(); it != path->streams.end(); ++it){
+				it->second->resumeReads(backend_stream::PAUSE_HANDOFF);
+			}
+		}
+	}
+}
+
+/**
+ * take every socket back from the engine. Whatever reads in flight still
+ * deliver is kept for the new process; completeHandoff() runs once the
+ * last socket is released.
+ */
+void client_bootstrap::freezeForHandoff(){
+	this->handoffFrozen = true;
+	this->handoff = handoff_state();
+	this->handoffPaths.clear();
+	this->handoffStreams.clear();
+	this->handoffReleases = 0;
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		tunnel_path* path = this->paths[i].get();
+		if(!path->isOpen()){
+			continue;
+		}
+		path->heartbeatTimer.cancel();
+		path->idleTimer.cancel();
+		memory_governor::instance().detach(path);
+		handoff_path hp;
+		hp.host = path->host;
+		hp.port = path->port;
+		hp.fd = (int)this->handoff.fds.size();
+		hp.draining = path->state == tunnel_path::DRAINING;
+		hp.srtt = path->srtt;
+		hp.accepted = path->accepted;
+		hp.refused = path->refused;
+		hp.frameChecksum = path->frameChecksum;
+		hp.checksumRequired = path->checksumRequired;
+		this->handoff.fds.push_back(path->fd);
+		this->handoff.paths.push_back(hp);
+		this->handoffPaths.push_back(path);
+		this->handoffReleases++;
+		this->p_ioEngine->release(path->fd, boost::bind(&rtunnel::client_bootstrap::handleReleased, this));
+		for(std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = path->streams.begin(); it != path->streams.end(); ++it){
+			int fd = it->second->handOver(boost::bind(&rtunnel::client_bootstrap::handleReleased, this));
+			if(fd < 0){
+				// beginHandoff() closed the kinds that can not go along.
+				client_bootstrap::logger.error(str(boost::format("stream %1% of path %2% can not be handed over, dropped.") % it->first % path->index));
+				continue;
+			}
+			handoff_stream hs;
+			hs.path = (int)this->handoff.paths.size() - 1;
+			hs.stream = it->first;
+			hs.fd = (int)this->handoff.fds.size();
+			this->handoff.fds.push_back(fd);
+			this->handoffStreams[std::make_pair(path, it->first)] = this->handoff.streams.size();
+			this->handoff.streams.push_back(hs);
+			this->handoffReleases++;
+		}
+	}
+	if(this->handoffReleases == 0){
+		this->completeHandoff();
+	}
+}
+
+void client_bootstrap::handleReleased(){
+	if(--this->handoffReleases == 0){
+		this->completeHandoff();
+	}
+}
+
+/**
+ * send the state and the sockets, then end the tunnel here without
+ * touching the connections. If the other process is gone by now, carry on
+ * with them instead.
+ */
+void client_bootstrap::completeHandoff(){
+	for(std::size_t i = 0; i < this->handoffPaths.size(); i++){
+		this->handoff.paths[i].inbound = this->handoffPaths[i]->inbound;
+	}
+	boost::system::error_code ec;
+	this->handoff.send(this->handoffFd, ec);
+	::close(this->handoffFd);
+	this->handoffFd = -1;
+	this->handoffStreamsPaused = false;
+	this->handoffFrozen = false;
+	for(std::size_t i = 0; i < this->handoffPaths.size(); i++){
+		tunnel_path* path = this->handoffPaths[i];
+		path->state = tunnel_path::DOWN;
+		memory_governor::instance().credit(path->inbound.size());
+		path->inbound.clear();
+		// handed over, they are closed for this process only.
+		path->streams.clear();
+		for(std::size_t j = 0; j < path->lingeringStreams.size(); j++){
+			path->lingeringStreams[j].first->close();
+		}
+		path->lingeringStreams.clear();
+		path->writer->close();
+		this->retiredWriters.push_back(path->writer);
+		path->writer.reset();
+		path->fd = -1;
+	}
+	if(ec){
+		client_bootstrap::logger.error(str(boost::format("handoff fails: %1%, carrying on.") % ec.message()));
+		this->adoptHandoff(this->handoff);
+		return;
+	}
+	client_bootstrap::logger.info(str(boost::format("handed over %1%, exiting.") % this->handoff.toString()));
+	this->handoff.closeAll();
+	this->mainKeepRunning = false;
+	this->p_ioEngine->stop();
+}
+
+/**
+ * carry on with a tunnel handed over to this process: the paths matching
+ * a configured transit server with their streams, what the old process
+ * had read but not handled yet included.
+ */
+void client_bootstrap::adoptHandoff(handoff_state& state){
+	for(std::size_t i = 0; i < state.paths.size(); i++){
+		handoff_path& hp = state.paths[i];
+		tunnel_path* path = NULL;
+		for(std::size_t j = 0; j < this->paths.size() && path == NULL; j++){
+			if(this->paths[j]->host == hp.host && this->paths[j]->port == hp.port && !this->paths[j]->isOpen()){
+				path = this->paths[j].get();
+			}
+		}
+		if(path == NULL){
+			client_bootstrap::logger.warn(str(boost::format("transit server %1%:%2% is not configured any more, its tunnel is closed.") % hp.host % hp.port));
+			continue;
+		}
+		this->openPath(path, state.take(hp.fd));
+		path->state = hp.draining ? tunnel_path::DRAINING : tunnel_path::UP;
+		path->srtt = hp.srtt;
+		path->accepted = hp.accepted;
+		path->refused = hp.refused;
+		// negotiated already, asking again would send unsealed frames
+		// until the ack.
+		path->frameChecksum = hp.frameChecksum;
+		path->checksumRequired = hp.checksumRequired;
+		for(std::size_t j = 0; j < state.streams.size(); j++){
+			handoff_stream& hs = state.streams[j];
+			if(hs.path != (int)i){
+				continue;
+			}
+			boost::shared_ptr<rtunnel::backend_stream> stream(new socket_backend_stream(*this->p_ioEngine, state.take(hs.fd)));
+			path->streams[hs.stream] = stream;
+			this->shapeStream(path, hs.stream, stream);
+			if(!hs.outbound.empty() && !this->sendData(path, hs.stream, &hs.outbound[0], hs.outbound.size())){
+				continue;
+			}
+			stream->start(boost::bind(&rtunnel::client_bootstrap::handleBackendData, this, path, hs.stream, _1, _2, _3));
+		}
+		path->inbound = hp.inbound;
+		memory_governor::instance().charge(path->inbound.size());
+		this->parseFrames(path);
+		client_bootstrap::logger.info(str(boost::format("adopted %1%") % path->toString()));
+	}
+	state.closeAll();
+}
+
+/**
+ * carry the tunnel over udp with its own reliability and congestion control,
+ * blocks until the tunnel closes. Only the first transit server is used.
+ */
+void client_bootstrap::runUdpTunnel(){
+	tunnel_path* path = this->paths[0].get();
+	if(this->paths.size() > 1){
+		client_bootstrap::logger.info("udp transport tunnels through the first transit server only.");
+	}
+	boost::posix_time::time_duration sinceEpoch = boost::posix_time::microsec_clock::universal_time() - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+	unsigned int conv = (unsigned int)sinceEpoch.total_microseconds() ^ ((unsigned int)this->clientConfig.forwardPort << 16);
+	path->udp = boost::shared_ptr<rtunnel::udp_tunnel>(new rtunnel::udp_tunnel(io_service, conv));
+	// backend connections run on an asio engine sharing the io_service.
+	this->p_ioEngine.reset();
+	this->p_ioEngine = io_engine::create("asio", io_service, packetPool);
+	path->engine = this->p_ioEngine.get();
+	path->udp->setLossInjection(this->clientConfig.udpLossRate, this->clientConfig.udpDelay);
+	path->udp->setReceiveHandler(boost::bind(&rtunnel::client_bootstrap::handleTunnelPacket, this, path, _1));
+	path->udp->setCloseHandler(boost::bind(&rtunnel::client_bootstrap::handleUdpClosed, this, path, _1));
+	path->udp->setResumeHandler(boost::bind(&rtunnel::client_bootstrap::resumeBackendStreams, this, path));
+	boost::system::error_code ec;
+	path->udp->connect(path->host, path->port, ec);
 	if(ec){
 		client_bootstrap::logger.info("connect to transit server fails, will try to reestablish it.");
 		this->cleanup();
+		path->udp.reset();
 		return;
 	}
+	path->pausedFor = 0;
+	memory_governor::instance().attach(path);
+	path->state = tunnel_path::UP;
+	path->srtt = -1;
+	path->heartbeatSentUs = -1;
+	this->requestModes(path);
+	this->timerWheel.arm(path->heartbeatTimer, this->clientConfig.heartbeatInterval * 1000);
+	this->timerWheel.arm(path->idleTimer, this->clientConfig.idleTimeout * 1000);
+	this->startTimers();
+	this->wheelTimer.expires_from_now(boost::posix_time::milliseconds(this->timerWheel.getTickMs()));
+	this->wheelTimer.async_wait(boost::bind(&rtunnel::client_bootstrap::handleWheelTimer, this, boost::asio::placeholders::error));
+	this->io_service.reset();
+	this->io_service.run();
+	this->closePath(path);
+	this->governorTimer.cancel();
+	this->pathTimer.cancel();
+	client_bootstrap::logger.info("udp tunnel closed, will try to reestablish it.");
+	this->cleanup();
+	path->udp.reset();
 }
 
 void client_bootstrap::stop(){
@@ -52,20 +1302,50 @@ void client_bootstrap::stop(){
 	if(this->p_clientLogicThread.get() != NULL && !this->p_clientLogicThread->interruption_requested()){
 		this->p_clientLogicThread->interrupt();
 	}
+	if(this->handoffListenFd >= 0){
+		// wakes the accept in serveHandoffs(). The path is left alone, the
+		// process that took over may be serving it by now.
+		::shutdown(this->handoffListenFd, SHUT_RDWR);
+		this->handoffThread->join();
+		::close(this->handoffListenFd);
+		this->handoffListenFd = -1;
+	}
+	int request = this->handoffRequest.exchange(-1);
+	if(request >= 0){
+		::close(request);
+	}
+	// connects not started yet are dropped, their sessions are over.
+	this->connectWork.reset();
+	this->connectService.stop();
+	for(std::size_t i = 0; i < this->connectThreads.size(); i++){
+		this->connectThreads[i]->timed_join(boost::posix_time::seconds(5));
+	}
+	this->connectThreads.clear();
 	this->cleanup();
-	boost::this_thread::sleep(boost::posix_time::seconds(5));
+	if(this->p_clientLogicThread.get() != NULL){
+		this->p_clientLogicThread->timed_join(boost::posix_time::seconds(5));
+	}
+	this->capture.close();
 }
 
 void client_bootstrap::cleanup(){
 	client_bootstrap::logger.debug("start cleanup.");
 	keepRunning = false;
-	if(this->p_socket.get() != NULL){
-		this->p_socket->close();
+	for(std::size_t i = 0; i < this->paths.size(); i++){
+		if(this->paths[i]->udp.get() != NULL){
+			this->paths[i]->udp->close();
+		}
+	}
+	if(this->p_ioEngine.get() != NULL){
+		this->p_ioEngine->stop();
 	}
 }
 
 client_bootstrap::~client_bootstrap() {
 	this->stop();
+	// the engine gives its buffers back to packetPool, which would go first.
+	this->retiredWriters.clear();
+	this->p_ioEngine.reset();
 	log4cpp::Category::shutdown();
 }
 
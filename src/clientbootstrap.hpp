@@ -8,11 +8,25 @@
 #ifndef CLIENTBOOTSTRAP_HPP_
 #define CLIENTBOOTSTRAP_HPP_
 
+#include <map>
 #include <boost/thread.hpp>
 #include <boost/smart_ptr.hpp>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 #include <log4cpp/Category.hh>
+#include "backendstream.hpp"
+#include "capture.hpp"
 #include "clientconfig.hpp"
+#include "controlschema.hpp"
+#include "handoff.hpp"
+#include "ioengine.hpp"
+#include "memorygovernor.hpp"
+#include "packetpool.hpp"
+#include "timerwheel.hpp"
+#include "tokenbucket.hpp"
+#include "tunnelpath.hpp"
+#include "tunnelwriter.hpp"
+#include "udptunnel.hpp"
 
 using boost::asio::ip::tcp;
 
@@ -25,15 +39,126 @@ public:
 	void stop();
 	virtual ~client_bootstrap();
 private:
+	const static unsigned int RESULT_OK = 0;
+	const static unsigned int RESULT_BACKEND_FAILED = 1;
+	const static unsigned int RESULT_PATH_DRAINING = 2;
+	const static unsigned int RESULT_RATE_LIMITED = 3;
+	// bytes one stream may have queued for its backend before it is reset
+	const static std::size_t MAX_BACKEND_BACKLOG = 4 * 1024 * 1024;
+	// threads making backend connections, however many streams open at once
+	const static int CONNECT_THREADS = 4;
+
 	void runClientLogic();
+	void runUdpTunnel();
+	bool connectPath(tunnel_path* path);
+	void reconnectPath(tunnel_path* path, int session, boost::shared_ptr<rtunnel::io_engine> engine);
+	void adoptPath(tunnel_path* path, int session, int fd);
+	void connectFailed(tunnel_path* path, int session);
+	void openPath(tunnel_path* path, int fd);
+	void closePath(tunnel_path* path);
+	void evaluatePaths();
+	void handleTunnelRead(tunnel_path* path, int fd, const unsigned char* data, std::size_t len, const boost::system::error_code& ec);
+	void parseFrames(tunnel_path* path);
+	void handleTunnelPacket(tunnel_path* path, packet& p);
+	template<typename Message> void sendControl(const Message& m);
+	template<typename Message> void sendControl(tunnel_path* path, const Message& m);
+	void requestModes(tunnel_path* path);
+	packet* obtainPacket(tunnel_path* path, int size);
+	bool sendPacket(tunnel_path* path, packet* p);
+	void startTimers();
+	void tickTimers();
+	void handleWheelTimer(const boost::system::error_code& ec);
+	void handleUdpClosed(tunnel_path* path, const boost::system::error_code& ec);
+	void sendHeartBeat(tunnel_path* path);
+	void handleIdle(tunnel_path* path);
+	void enforceMemory();
+	void runConnector();
+	void connectBackend(tunnel_path* path, int session, unsigned int stream, unsigned long ticket, boost::shared_ptr<rtunnel::io_engine> engine);
+	void adoptBackendStream(tunnel_path* path, int session, unsigned int stream, unsigned long ticket,
+			boost::shared_ptr<rtunnel::backend_stream> s, boost::system::error_code ec);
+	void handleBackendData(tunnel_path* path, unsigned int stream, const unsigned char* data, std::size_t len, const boost::system::error_code& ec);
+	bool sendData(tunnel_path* path, unsigned int stream, const unsigned char* data, std::size_t len);
+	void resetStream(tunnel_path* path, unsigned int stream, const std::string& reason);
+	void shapeStream(tunnel_path* path, unsigned int stream, boost::shared_ptr<rtunnel::backend_stream> s);
+	void shapeBackendData(backend_stream& s, std::size_t len);
+	void resumeShapedStream(tunnel_path* path, unsigned int stream);
+	void closeBackendStream(tunnel_path* path, unsigned int stream);
+	void reapLingeringStreams(tunnel_path* path);
+	void closeBackendStreams(tunnel_path* path);
+	void resumeBackendStreams(tunnel_path* path);
+	void reapRetiredWriters();
+	void serveHandoffs();
+	void takeOver();
+	bool isHandingOff();
+	void beginHandoff(int fd);
+	void checkHandoff();
+	bool isFlushed(bool tunnels);
+	void abortHandoff(const std::string& reason);
+	void freezeForHandoff();
+	void handleReleased();
+	void completeHandoff();
+	void adoptHandoff(handoff_state& state);
+	void onControl(const heart_beat_message& m, packet& p);
+	void onControl(const ack_heart_beat_message& m, packet& p);
+	void onControl(const create_tcp_server_message& m, packet& p);
+	void onControl(const ack_create_tcp_server_message& m, packet& p);
+	void onControl(const new_tcp_socket_message& m, packet& p);
+	void onControl(const ack_new_tcp_socket_message& m, packet& p);
+	void onControl(const close_tunnel_message& m, packet& p);
+	void onControl(const tunnel_mode_message& m, packet& p);
+	void onControl(const ack_tunnel_mode_message& m, packet& p);
+	void onPacket(packet& p);
+	void onMalformed(packet& p);
+	template<typename Handler, typename Message> friend struct schema::dispatch_entry;
 	void cleanup();
 	rtunnel::client_config clientConfig;
 	bool mainKeepRunning;
 	bool keepRunning;
 	static log4cpp::Category& logger;
-	boost::shared_ptr<tcp::socket> p_socket;
+	boost::shared_ptr<rtunnel::io_engine> p_ioEngine;
+	std::vector<boost::shared_ptr<rtunnel::tunnel_path> > paths;
+	// the path of the packet being dispatched
+	tunnel_path* currentPath;
+	// writers of closed paths, kept until their last drain has run
+	std::vector<boost::shared_ptr<rtunnel::tunnel_writer> > retiredWriters;
+	int session;
+	int governorTicks;
+	int pathTicks;
+	rtunnel::backend_address backendAddress;
+	// the mapping's limits, over all its backend connections
+	rtunnel::token_bucket mappingBytes;
+	rtunnel::token_bucket mappingStreams;
 	boost::shared_ptr<boost::thread> p_clientLogicThread;
 	boost::asio::io_service io_service;
+	rtunnel::packet_pool packetPool;
+	rtunnel::timer_wheel timerWheel;
+	rtunnel::wheel_timer governorTimer;
+	rtunnel::wheel_timer pathTimer;
+	int handoffListenFd;
+	boost::shared_ptr<boost::thread> handoffThread;
+	// accepted by handoffThread, picked up on the engine thread
+	boost::atomic<int> handoffRequest;
+	// the process taking over, -1 while no handoff is in progress
+	int handoffFd;
+	// everything for the backends is written, they are not read any more
+	bool handoffStreamsPaused;
+	// reads are released, whatever still arrives is handed over
+	bool handoffFrozen;
+	int handoffTicks;
+	int handoffReleases;
+	rtunnel::handoff_state handoff;
+	std::vector<tunnel_path*> handoffPaths;
+	std::map<std::pair<tunnel_path*, unsigned int>, std::size_t> handoffStreams;
+	rtunnel::wheel_timer handoffTimer;
+	// received from the process this one replaced, adopted by the first session
+	boost::shared_ptr<rtunnel::handoff_state> takenOver;
+	rtunnel::frame_capture capture;
+	bool capturing;
+	boost::asio::deadline_timer wheelTimer;
+	// backend connects queue here and block one of connectThreads each
+	boost::asio::io_service connectService;
+	boost::shared_ptr<boost::asio::io_service::work> connectWork;
+	std::vector<boost::shared_ptr<boost::thread> > connectThreads;
 };
 } /* namespace rtunnel */
 #endif /* CLIENTBOOTSTRAP_HPP_ */
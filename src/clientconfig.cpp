@@ -6,6 +6,9 @@
  */
 
 #include "clientconfig.hpp"
+#include <iostream>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 using namespace std;
 
@@ -14,7 +17,7 @@ namespace rtunnel {
 
 namespace po = boost::program_options;
 
-client_config::client_config():rtunnelServerHost(), rtunnelServerPort(0), tcpHost(), tcpPort(0), forwardPort(0){
+client_config::client_config():rtunnelServerHost(), rtunnelServerPort(0), tcpHost(), tcpPort(0), forwardPort(0), tunnelTransport("tcp"), udpLossRate(0), udpDelay(0), ioEngine("asio"), heartbeatInterval(10), idleTimeout(30), memoryBudget(0), rateLimit(0), streamRateLimit(0), acceptRate(0), handoffPath(), takeover(false), frameChecksum(false), captureFile(), replayFile(), replayTiming("fast"), replayLoops(1){
 }
 
 void client_config::init(int ac, char* av[]) {
@@ -22,11 +25,28 @@ void client_config::init(int ac, char* av[]) {
 	po::options_description desc("Allowed options");
 	desc.add_options()
 			("help", "print this help message")
-			("rtunnelServerHost,h", po::value<string>(), "rtunnel server host")
+			("rtunnelServerHost,h", po::value<string>(), "rtunnel server host, or a comma separated list of host[:port] to tunnel through all of them at once")
 			("rtunnelServerPort,p", po::value<int>(), "rtunnel server port")
-			("tcpHost", po::value<string>(), "tcp host")
+			("tcpHost", po::value<string>(), "backend host, or unix:/path for a unix socket, or shm:/path for shared memory rings set up over that unix socket")
 			("tcpPort", po::value<int>(), "tcp port")
-			("forwardPort", po::value<int>(), "forward port");
+			("forwardPort", po::value<int>(), "forward port")
+			("tunnelTransport", po::value<string>(), "tunnel transport, tcp or udp (default tcp)")
+			("udpLossRate", po::value<double>(), "drop this fraction of outgoing udp tunnel datagrams, for testing")
+			("udpDelay", po::value<int>(), "delay outgoing udp tunnel datagrams by this many milliseconds, for testing")
+			("ioEngine", po::value<string>(), "socket io engine, asio or uring (default asio, uring falls back to asio when unavailable)")
+			("heartbeatInterval", po::value<int>(), "seconds between heart beats sent to the transit server (default 10)")
+			("idleTimeout", po::value<int>(), "close the tunnel after this many seconds without a packet from the transit server (default 30)")
+			("memoryBudget", po::value<int>(), "KB of buffered payload before reads on the heaviest streams are paused (default 0, unlimited)")
+			("rateLimit", po::value<int>(), "KB/s read from the backend connections of the mapping all together, reads pause above it (default 0, unlimited)")
+			("streamRateLimit", po::value<int>(), "KB/s read from each backend connection (default 0, unlimited)")
+			("acceptRate", po::value<double>(), "new streams a second the mapping takes, more are refused (default 0, unlimited)")
+			("handoffPath", po::value<string>(), "unix socket where a new client process can take over the live tunnel and streams (default none)")
+			("takeover", "take over the tunnel and streams from the client listening on handoffPath, then serve handoffPath in its place")
+			("frameChecksum", "ask the transit servers for a crc32c on every frame, both ways")
+			("captureFile", po::value<string>(), "append every tunnel frame sent and received to this file (default none)")
+			("replay", po::value<string>(), "play a capture file back through the packet layer and report the throughput, instead of running the tunnel")
+			("replayTiming", po::value<string>(), "replay as fast as possible or at the recorded pace, fast or original (default fast)")
+			("replayLoops", po::value<int>(), "play the capture this many times over (default 1)");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(ac, av, desc), vm);
@@ -37,6 +57,26 @@ void client_config::init(int ac, char* av[]) {
 		exit(1);
 	}
 
+	if (vm.count("replay")) {
+		// nothing is connected to, the other options do not matter.
+		this->replayFile = vm["replay"].as<string>();
+		if (vm.count("replayTiming")) {
+			this->replayTiming = vm["replayTiming"].as<string>();
+			if (this->replayTiming != "fast" && this->replayTiming != "original") {
+				cout << "replayTiming must be fast or original." << endl;
+				exit(1);
+			}
+		}
+		if (vm.count("replayLoops")) {
+			this->replayLoops = vm["replayLoops"].as<int>();
+			if (this->replayLoops < 1) {
+				cout << "replayLoops must be at least 1." << endl;
+				exit(1);
+			}
+		}
+		return;
+	}
+
 	if (vm.count("rtunnelServerHost")) {
 		this->rtunnelServerHost = vm["rtunnelServerHost"].as<string>();
 	} else {
@@ -51,6 +91,33 @@ void client_config::init(int ac, char* av[]) {
 		exit(1);
 	}
 
+	std::vector<string> servers;
+	boost::split(servers, this->rtunnelServerHost, boost::is_any_of(","));
+	for (std::size_t i = 0; i < servers.size(); i++) {
+		string server = boost::trim_copy(servers[i]);
+		if (server.empty()) {
+			continue;
+		}
+		int port = this->rtunnelServerPort;
+		string::size_type colon = server.rfind(':');
+		if (colon != string::npos) {
+			try {
+				port = boost::lexical_cast<int>(server.substr(colon + 1));
+			} catch (boost::bad_lexical_cast& e) {
+				cout << "bad transit server " << server << endl;
+				exit(1);
+			}
+			server = server.substr(0, colon);
+		}
+		this->transitServers.push_back(std::make_pair(server, port));
+	}
+	if (this->transitServers.empty()) {
+		cout << "rtunnelServerHost was not set." << endl;
+		exit(1);
+	}
+	this->rtunnelServerHost = this->transitServers[0].first;
+	this->rtunnelServerPort = this->transitServers[0].second;
+
 	if (vm.count("tcpHost")) {
 		this->tcpHost = vm["tcpHost"].as<string>();
 	} else {
@@ -71,6 +138,90 @@ void client_config::init(int ac, char* av[]) {
 		cout << "forwardPort was not set." << endl;
 		exit(1);
 	}
+
+	if (vm.count("tunnelTransport")) {
+		this->tunnelTransport = vm["tunnelTransport"].as<string>();
+		if (this->tunnelTransport != "tcp" && this->tunnelTransport != "udp") {
+			cout << "tunnelTransport must be tcp or udp." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("udpLossRate")) {
+		this->udpLossRate = vm["udpLossRate"].as<double>();
+	}
+
+	if (vm.count("udpDelay")) {
+		this->udpDelay = vm["udpDelay"].as<int>();
+	}
+
+	if (vm.count("ioEngine")) {
+		this->ioEngine = vm["ioEngine"].as<string>();
+		if (this->ioEngine != "asio" && this->ioEngine != "uring") {
+			cout << "ioEngine must be asio or uring." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("heartbeatInterval")) {
+		this->heartbeatInterval = vm["heartbeatInterval"].as<int>();
+	}
+
+	if (vm.count("idleTimeout")) {
+		this->idleTimeout = vm["idleTimeout"].as<int>();
+	}
+
+	if (vm.count("memoryBudget")) {
+		this->memoryBudget = vm["memoryBudget"].as<int>();
+		if (this->memoryBudget < 0) {
+			cout << "memoryBudget must not be negative." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("rateLimit")) {
+		this->rateLimit = vm["rateLimit"].as<int>();
+		if (this->rateLimit < 0) {
+			cout << "rateLimit must not be negative." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("streamRateLimit")) {
+		this->streamRateLimit = vm["streamRateLimit"].as<int>();
+		if (this->streamRateLimit < 0) {
+			cout << "streamRateLimit must not be negative." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("acceptRate")) {
+		this->acceptRate = vm["acceptRate"].as<double>();
+		if (this->acceptRate < 0) {
+			cout << "acceptRate must not be negative." << endl;
+			exit(1);
+		}
+	}
+
+	if (vm.count("handoffPath")) {
+		this->handoffPath = vm["handoffPath"].as<string>();
+	}
+
+	if (vm.count("takeover")) {
+		if (this->handoffPath.empty()) {
+			cout << "takeover needs handoffPath." << endl;
+			exit(1);
+		}
+		this->takeover = true;
+	}
+
+	if (vm.count("frameChecksum")) {
+		this->frameChecksum = true;
+	}
+
+	if (vm.count("captureFile")) {
+		this->captureFile = vm["captureFile"].as<string>();
+	}
 }
 
 client_config::~client_config() {
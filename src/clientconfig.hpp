@@ -9,6 +9,7 @@
 #define CLIENTCONFIG_HPP_
 
 #include <string>
+#include <vector>
 #include <boost/program_options.hpp>
 
 using namespace std;
@@ -22,9 +23,28 @@ public:
 	virtual ~client_config();
 	string rtunnelServerHost;
 	int rtunnelServerPort;
+	// rtunnelServerHost split into host, port pairs
+	std::vector<std::pair<string, int> > transitServers;
 	string tcpHost;
 	int tcpPort;
 	int forwardPort;
+	string tunnelTransport;
+	double udpLossRate;
+	int udpDelay;
+	string ioEngine;
+	int heartbeatInterval;
+	int idleTimeout;
+	int memoryBudget;
+	int rateLimit;
+	int streamRateLimit;
+	double acceptRate;
+	string handoffPath;
+	bool takeover;
+	bool frameChecksum;
+	string captureFile;
+	string replayFile;
+	string replayTiming;
+	int replayLoops;
 };
 
 }  // namespace rtunnel
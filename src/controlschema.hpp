@@ -0,0 +1,276 @@
+/*
+ * controlschema.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef CONTROLSCHEMA_HPP_
+#define CONTROLSCHEMA_HPP_
+
+#include <string.h>
+#include <boost/endian/conversion.hpp>
+#include <boost/static_assert.hpp>
+#include "packet.hpp"
+
+namespace rtunnel {
+
+/**
+ * compile-time layout of the control packets.
+ *
+ * Each control message declares its fields once:
+ *
+ *   struct heart_beat_message {
+ *       enum { PROTOCOL = packet::HEART_BEAT };
+ *       unsigned long long time;
+ *       typedef schema::fields<schema::u64<heart_beat_message, &heart_beat_message::time> > layout;
+ *   };
+ *
+ * layout::SIZE is the encoded size, known at compile time, and
+ * schema::encode()/decode() move the fields straight between the message
+ * and the packet buffer as big endian words.
+ */
+namespace schema {
+
+template<typename Value>
+struct big_endian {
+	static void store(unsigned char* out, Value v) {
+		v = boost::endian::native_to_big(v);
+		memcpy(out, &v, sizeof(v));
+	}
+	static Value load(const unsigned char* in) {
+		Value v;
+		memcpy(&v, in, sizeof(v));
+		return boost::endian::big_to_native(v);
+	}
+};
+
+template<typename Message, typename Value, Value Message::*Member>
+struct field {
+	enum { SIZE = sizeof(Value) };
+	static void encode(unsigned char* out, const Message& m) {
+		big_endian<Value>::store(out, m.*Member);
+	}
+	static void decode(const unsigned char* in, Message& m) {
+		m.*Member = big_endian<Value>::load(in);
+	}
+};
+
+template<typename Message, unsigned char Message::*Member>
+struct u8: field<Message, unsigned char, Member> {
+};
+
+template<typename Message, unsigned short Message::*Member>
+struct u16: field<Message, unsigned short, Member> {
+};
+
+template<typename Message, unsigned int Message::*Member>
+struct u32: field<Message, unsigned int, Member> {
+};
+
+template<typename Message, unsigned long long Message::*Member>
+struct u64: field<Message, unsigned long long, Member> {
+};
+
+struct none {
+	enum { SIZE = 0 };
+	template<typename Message>
+	static void encode(unsigned char*, const Message&) {
+	}
+	template<typename Message>
+	static void decode(const unsigned char*, Message&) {
+	}
+};
+
+template<typename F1 = none, typename F2 = none, typename F3 = none, typename F4 = none>
+struct fields {
+	enum { SIZE = F1::SIZE + F2::SIZE + F3::SIZE + F4::SIZE };
+	template<typename Message>
+	static void encode(unsigned char* out, const Message& m) {
+		F1::encode(out, m);
+		F2::encode(out + F1::SIZE, m);
+		F3::encode(out + F1::SIZE + F2::SIZE, m);
+		F4::encode(out + F1::SIZE + F2::SIZE + F3::SIZE, m);
+	}
+	template<typename Message>
+	static void decode(const unsigned char* in, Message& m) {
+		F1::decode(in, m);
+		F2::decode(in + F1::SIZE, m);
+		F3::decode(in + F1::SIZE + F2::SIZE, m);
+		F4::decode(in + F1::SIZE + F2::SIZE + F3::SIZE, m);
+	}
+};
+
+/**
+ * make p a Message control packet.
+ */
+template<typename Message>
+void encode(packet& p, const Message& m) {
+	p.clear();
+	p.setProtocol(Message::PROTOCOL);
+	Message::layout::encode(p.reserveData(Message::layout::SIZE), m);
+}
+
+/**
+ * @return false if p is too short to hold a Message.
+ */
+template<typename Message>
+bool decode(packet& p, Message& m) {
+	if (p.getDataLen() < (int) Message::layout::SIZE) {
+		return false;
+	}
+	Message::layout::decode(p.dataAt(0), m);
+	return true;
+}
+
+} /* namespace schema */
+
+struct heart_beat_message {
+	enum { PROTOCOL = packet::HEART_BEAT };
+	unsigned long long time;
+	typedef schema::fields<schema::u64<heart_beat_message, &heart_beat_message::time> > layout;
+};
+
+struct ack_heart_beat_message {
+	enum { PROTOCOL = packet::ACK_HEART_BEAT };
+	unsigned long long time;
+	typedef schema::fields<schema::u64<ack_heart_beat_message, &ack_heart_beat_message::time> > layout;
+};
+
+struct create_tcp_server_message {
+	enum { PROTOCOL = packet::CREATE_TCP_SERVER };
+	unsigned int port;
+	typedef schema::fields<schema::u32<create_tcp_server_message, &create_tcp_server_message::port> > layout;
+};
+
+struct ack_create_tcp_server_message {
+	enum { PROTOCOL = packet::ACK_CREATE_TCP_SERVER };
+	unsigned int result;
+	typedef schema::fields<schema::u32<ack_create_tcp_server_message, &ack_create_tcp_server_message::result> > layout;
+};
+
+/**
+ * the transit server accepted a connection on forwardPort, stream ids are
+ * chosen by the server.
+ */
+struct new_tcp_socket_message {
+	enum { PROTOCOL = packet::NEW_TCP_SOCKET };
+	unsigned int stream;
+	typedef schema::fields<schema::u32<new_tcp_socket_message, &new_tcp_socket_message::stream> > layout;
+};
+
+/**
+ * result 0 when the backend connection is up.
+ */
+struct ack_new_tcp_socket_message {
+	enum { PROTOCOL = packet::ACK_NEW_TCP_SOCKET };
+	unsigned int stream;
+	unsigned int result;
+	typedef schema::fields<schema::u32<ack_new_tcp_socket_message, &ack_new_tcp_socket_message::stream>,
+			schema::u32<ack_new_tcp_socket_message, &ack_new_tcp_socket_message::result> > layout;
+};
+
+struct close_tunnel_message {
+	enum { PROTOCOL = packet::CLOSE_TUNNEL };
+	typedef schema::fields<> layout;
+};
+
+/**
+ * mode bits one side asks for; the ack carries the ones granted.
+ */
+struct tunnel_mode_message {
+	enum { PROTOCOL = packet::TUNNEL_MODE };
+	// frames may carry a crc32c trailer, packet::CHECKSUMMED
+	enum { FRAME_CHECKSUM = 0x20 };
+	unsigned int mode;
+	typedef schema::fields<schema::u32<tunnel_mode_message, &tunnel_mode_message::mode> > layout;
+};
+
+struct ack_tunnel_mode_message {
+	enum { PROTOCOL = packet::ACK_TUNNEL_MODE };
+	unsigned int mode;
+	typedef schema::fields<schema::u32<ack_tunnel_mode_message, &ack_tunnel_mode_message::mode> > layout;
+};
+
+BOOST_STATIC_ASSERT(heart_beat_message::layout::SIZE == 8);
+BOOST_STATIC_ASSERT(ack_new_tcp_socket_message::layout::SIZE == 8);
+BOOST_STATIC_ASSERT(close_tunnel_message::layout::SIZE == 0);
+
+namespace schema {
+
+/**
+ * protocol number -> message type; protocols without a schema (DATA, the
+ * DH keys) map to void.
+ */
+template<int Protocol>
+struct message_for {
+	typedef void type;
+};
+
+template<> struct message_for<packet::HEART_BEAT> { typedef heart_beat_message type; };
+template<> struct message_for<packet::ACK_HEART_BEAT> { typedef ack_heart_beat_message type; };
+template<> struct message_for<packet::CREATE_TCP_SERVER> { typedef create_tcp_server_message type; };
+template<> struct message_for<packet::ACK_CREATE_TCP_SERVER> { typedef ack_create_tcp_server_message type; };
+template<> struct message_for<packet::NEW_TCP_SOCKET> { typedef new_tcp_socket_message type; };
+template<> struct message_for<packet::ACK_NEW_TCP_SOCKET> { typedef ack_new_tcp_socket_message type; };
+template<> struct message_for<packet::CLOSE_TUNNEL> { typedef close_tunnel_message type; };
+template<> struct message_for<packet::TUNNEL_MODE> { typedef tunnel_mode_message type; };
+template<> struct message_for<packet::ACK_TUNNEL_MODE> { typedef ack_tunnel_mode_message type; };
+
+template<typename Handler, typename Message>
+struct dispatch_entry {
+	static void call(Handler& handler, packet& p) {
+		Message m;
+		if (decode(p, m)) {
+			handler.onControl(m, p);
+		} else {
+			handler.onMalformed(p);
+		}
+	}
+};
+
+template<typename Handler>
+struct dispatch_entry<Handler, void> {
+	static void call(Handler& handler, packet& p) {
+		handler.onPacket(p);
+	}
+};
+
+template<typename Handler, int Protocol>
+struct entry_for: dispatch_entry<Handler, typename message_for<Protocol>::type> {
+};
+
+} /* namespace schema */
+
+/**
+ * routes a packet to Handler by protocol through a table built at compile
+ * time. Handler provides onControl(const M&, packet&) for every message
+ * with a schema, onPacket(packet&) for the rest and onMalformed(packet&)
+ * for control packets too short for their schema. A missing overload is a
+ * compile error.
+ */
+template<typename Handler>
+class control_dispatcher {
+public:
+	static void dispatch(Handler& handler, packet& p) {
+		table[p.getProtocol()](handler, p);
+	}
+private:
+	typedef void (*entry)(Handler&, packet&);
+	static const entry table[16];
+};
+
+template<typename Handler>
+const typename control_dispatcher<Handler>::entry control_dispatcher<Handler>::table[16] = {
+	&schema::entry_for<Handler, 0x00>::call, &schema::entry_for<Handler, 0x01>::call,
+	&schema::entry_for<Handler, 0x02>::call, &schema::entry_for<Handler, 0x03>::call,
+	&schema::entry_for<Handler, 0x04>::call, &schema::entry_for<Handler, 0x05>::call,
+	&schema::entry_for<Handler, 0x06>::call, &schema::entry_for<Handler, 0x07>::call,
+	&schema::entry_for<Handler, 0x08>::call, &schema::entry_for<Handler, 0x09>::call,
+	&schema::entry_for<Handler, 0x0a>::call, &schema::entry_for<Handler, 0x0b>::call,
+	&schema::entry_for<Handler, 0x0c>::call, &schema::entry_for<Handler, 0x0d>::call,
+	&schema::entry_for<Handler, 0x0e>::call, &schema::entry_for<Handler, 0x0f>::call
+};
+
+} /* namespace rtunnel */
+#endif /* CONTROLSCHEMA_HPP_ */
@@ -0,0 +1,227 @@
+/*
+ * crc32c.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "crc32c.hpp"
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace rtunnel {
+
+// reflected castagnoli polynomial
+static const boost::uint32_t POLY = 0x82f63b78;
+// lane lengths of the interleaved hardware crc
+static const std::size_t LONG_LANE = 8192;
+static const std::size_t SHORT_LANE = 256;
+
+static boost::uint32_t gf2MatrixTimes(const boost::uint32_t* mat, boost::uint32_t vec) {
+	boost::uint32_t sum = 0;
+	while (vec) {
+		if (vec & 1) {
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+static void gf2MatrixSquare(boost::uint32_t* square, const boost::uint32_t* mat) {
+	for (int n = 0; n < 32; n++) {
+		square[n] = gf2MatrixTimes(mat, mat[n]);
+	}
+}
+
+/**
+ * the tables, built once at startup.
+ *
+ * slices[k][b] is the crc of byte b followed by k zero bytes. zeros
+ * shift a crc over len zero bytes (len a power of 2), which is how the
+ * crc of three lanes computed side by side is put back together.
+ */
+struct crc32c_tables {
+	boost::uint32_t slices[8][256];
+	boost::uint32_t longZeros[4][256];
+	boost::uint32_t shortZeros[4][256];
+
+	crc32c_tables() {
+		for (boost::uint32_t n = 0; n < 256; n++) {
+			boost::uint32_t crc = n;
+			for (int k = 0; k < 8; k++) {
+				crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+			}
+			slices[0][n] = crc;
+		}
+		for (int n = 0; n < 256; n++) {
+			for (int k = 1; k < 8; k++) {
+				slices[k][n] = (slices[k - 1][n] >> 8) ^ slices[0][slices[k - 1][n] & 0xff];
+			}
+		}
+		zeros(longZeros, LONG_LANE);
+		zeros(shortZeros, SHORT_LANE);
+	}
+
+	static void zeros(boost::uint32_t table[4][256], std::size_t len) {
+		boost::uint32_t even[32];
+		boost::uint32_t odd[32];
+		// one zero bit
+		odd[0] = POLY;
+		boost::uint32_t row = 1;
+		for (int n = 1; n < 32; n++) {
+			odd[n] = row;
+			row <<= 1;
+		}
+		// two, then four zero bits; each square below doubles it from one byte on
+		gf2MatrixSquare(even, odd);
+		gf2MatrixSquare(odd, even);
+		boost::uint32_t* op = even;
+		while (true) {
+			gf2MatrixSquare(even, odd);
+			len >>= 1;
+			if (len == 0) {
+				op = even;
+				break;
+			}
+			gf2MatrixSquare(odd, even);
+			len >>= 1;
+			if (len == 0) {
+				op = odd;
+				break;
+			}
+		}
+		for (boost::uint32_t n = 0; n < 256; n++) {
+			table[0][n] = gf2MatrixTimes(op, n);
+			table[1][n] = gf2MatrixTimes(op, n << 8);
+			table[2][n] = gf2MatrixTimes(op, n << 16);
+			table[3][n] = gf2MatrixTimes(op, n << 24);
+		}
+	}
+
+	static boost::uint32_t shift(const boost::uint32_t table[4][256], boost::uint32_t crc) {
+		return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+	}
+};
+
+static const crc32c_tables tables;
+
+static boost::uint32_t loadLittleEndian(const unsigned char* p) {
+	return (boost::uint32_t) p[0] | ((boost::uint32_t) p[1] << 8) | ((boost::uint32_t) p[2] << 16) | ((boost::uint32_t) p[3] << 24);
+}
+
+boost::uint32_t crc32cTable(boost::uint32_t crc, const unsigned char* data, std::size_t len) {
+	crc = ~crc;
+	while (len >= 8) {
+		boost::uint32_t low = crc ^ loadLittleEndian(data);
+		boost::uint32_t high = loadLittleEndian(data + 4);
+		crc = tables.slices[7][low & 0xff] ^ tables.slices[6][(low >> 8) & 0xff] ^ tables.slices[5][(low >> 16) & 0xff]
+				^ tables.slices[4][low >> 24] ^ tables.slices[3][high & 0xff] ^ tables.slices[2][(high >> 8) & 0xff]
+				^ tables.slices[1][(high >> 16) & 0xff] ^ tables.slices[0][high >> 24];
+		data += 8;
+		len -= 8;
+	}
+	while (len > 0) {
+		crc = (crc >> 8) ^ tables.slices[0][(crc ^ *data) & 0xff];
+		data++;
+		len--;
+	}
+	return ~crc;
+}
+
+#if defined(__x86_64__)
+
+static boost::uint64_t load64(const unsigned char* p) {
+	boost::uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+/**
+ * the crc32 instruction has a latency of 3 cycles and a throughput of 1,
+ * so three independent lanes keep it busy; their crcs are combined with
+ * the zeros tables.
+ */
+__attribute__((target("sse4.2")))
+static boost::uint32_t crc32cHardware(boost::uint32_t crc, const unsigned char* data, std::size_t len) {
+	boost::uint64_t crc0 = ~crc;
+	while (len > 0 && ((std::size_t) data & 7) != 0) {
+		crc0 = _mm_crc32_u8((boost::uint32_t) crc0, *data);
+		data++;
+		len--;
+	}
+	while (len >= LONG_LANE * 3) {
+		boost::uint64_t crc1 = 0;
+		boost::uint64_t crc2 = 0;
+		const unsigned char* end = data + LONG_LANE;
+		do {
+			crc0 = _mm_crc32_u64(crc0, load64(data));
+			crc1 = _mm_crc32_u64(crc1, load64(data + LONG_LANE));
+			crc2 = _mm_crc32_u64(crc2, load64(data + LONG_LANE * 2));
+			data += 8;
+		} while (data < end);
+		crc0 = crc32c_tables::shift(tables.longZeros, (boost::uint32_t) crc0) ^ (boost::uint32_t) crc1;
+		crc0 = crc32c_tables::shift(tables.longZeros, (boost::uint32_t) crc0) ^ (boost::uint32_t) crc2;
+		data += LONG_LANE * 2;
+		len -= LONG_LANE * 3;
+	}
+	while (len >= SHORT_LANE * 3) {
+		boost::uint64_t crc1 = 0;
+		boost::uint64_t crc2 = 0;
+		const unsigned char* end = data + SHORT_LANE;
+		do {
+			crc0 = _mm_crc32_u64(crc0, load64(data));
+			crc1 = _mm_crc32_u64(crc1, load64(data + SHORT_LANE));
+			crc2 = _mm_crc32_u64(crc2, load64(data + SHORT_LANE * 2));
+			data += 8;
+		} while (data < end);
+		crc0 = crc32c_tables::shift(tables.shortZeros, (boost::uint32_t) crc0) ^ (boost::uint32_t) crc1;
+		crc0 = crc32c_tables::shift(tables.shortZeros, (boost::uint32_t) crc0) ^ (boost::uint32_t) crc2;
+		data += SHORT_LANE * 2;
+		len -= SHORT_LANE * 3;
+	}
+	while (len >= 8) {
+		crc0 = _mm_crc32_u64(crc0, load64(data));
+		data += 8;
+		len -= 8;
+	}
+	while (len > 0) {
+		crc0 = _mm_crc32_u8((boost::uint32_t) crc0, *data);
+		data++;
+		len--;
+	}
+	return ~(boost::uint32_t) crc0;
+}
+
+static bool hasHardware() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+
+#endif
+
+typedef boost::uint32_t (*crc32c_function)(boost::uint32_t, const unsigned char*, std::size_t);
+
+static crc32c_function selectCrc32c() {
+#if defined(__x86_64__)
+	if (hasHardware()) {
+		return &crc32cHardware;
+	}
+#endif
+	return &crc32cTable;
+}
+
+static const crc32c_function implementation = selectCrc32c();
+
+boost::uint32_t crc32c(boost::uint32_t crc, const unsigned char* data, std::size_t len) {
+	return implementation(crc, data, len);
+}
+
+const char* crc32cImplementation() {
+	return implementation == &crc32cTable ? "table" : "sse4.2";
+}
+
+} /* namespace rtunnel */
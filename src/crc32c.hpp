@@ -0,0 +1,36 @@
+/*
+ * crc32c.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef CRC32C_HPP_
+#define CRC32C_HPP_
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace rtunnel {
+
+/**
+ * crc32c (castagnoli) of data, continuing crc, which is 0 to start with.
+ *
+ * Uses the sse4.2 crc32 instruction when the cpu has it, over three
+ * interleaved lanes for long buffers, and a slicing by 8 table otherwise.
+ */
+boost::uint32_t crc32c(boost::uint32_t crc, const unsigned char* data, std::size_t len);
+
+/**
+ * crc32c() on the slicing by 8 table whatever the cpu has, what the
+ * sse4.2 path is checked against.
+ */
+boost::uint32_t crc32cTable(boost::uint32_t crc, const unsigned char* data, std::size_t len);
+
+/**
+ * "sse4.2" or "table", whichever crc32c() runs on.
+ */
+const char* crc32cImplementation();
+
+} /* namespace rtunnel */
+#endif /* CRC32C_HPP_ */
@@ -0,0 +1,95 @@
+/*
+ * crc32ctest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "crc32c.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace rtunnel;
+
+/**
+ * crc32c() against the standard check values, and against the table on
+ * every length and alignment the sse4.2 path treats differently: the
+ * unaligned head, the short and long three lane blocks and the tail.
+ */
+static const std::size_t LONG_BLOCK = 3 * 8192;
+static const std::size_t SHORT_BLOCK = 3 * 256;
+
+static bool failed = false;
+
+static void expectCrc(const std::string& what, boost::uint32_t crc, boost::uint32_t expected) {
+	if (crc != expected) {
+		std::cout << what << ": " << std::hex << crc << " instead of " << expected << std::dec << std::endl;
+		failed = true;
+	}
+}
+
+static void testCheckValues() {
+	const std::string check = "123456789";
+	const unsigned char* digits = (const unsigned char*) check.data();
+	expectCrc("check value", crc32c(0, digits, check.size()), 0xe3069283);
+	expectCrc("check value on the table", crc32cTable(0, digits, check.size()), 0xe3069283);
+	// the iscsi test vectors, rfc 3720 b.4
+	std::vector<unsigned char> bytes(32, 0);
+	expectCrc("32 zeros", crc32c(0, &bytes[0], bytes.size()), 0x8a9136aa);
+	bytes.assign(32, 0xff);
+	expectCrc("32 ones", crc32c(0, &bytes[0], bytes.size()), 0x62a8ab43);
+	for (int i = 0; i < 32; i++) {
+		bytes[i] = (unsigned char) i;
+	}
+	expectCrc("32 ascending", crc32c(0, &bytes[0], bytes.size()), 0x46dd794e);
+	for (int i = 0; i < 32; i++) {
+		bytes[i] = (unsigned char) (31 - i);
+	}
+	expectCrc("32 descending", crc32c(0, &bytes[0], bytes.size()), 0x113fdb5c);
+	expectCrc("nothing", crc32c(0, digits, 0), 0);
+}
+
+static void expectSame(const unsigned char* data, std::size_t len, std::size_t align) {
+	boost::uint32_t expected = crc32cTable(0, data, len);
+	boost::uint32_t crc = crc32c(0, data, len);
+	if (crc != expected) {
+		std::cout << len << " bytes at alignment " << align << ": " << std::hex << crc << " instead of " << expected << std::dec
+				<< std::endl;
+		failed = true;
+	}
+	// continued from a crc of the first part, as a frame trailer is.
+	std::size_t split = len / 3;
+	crc = crc32c(crc32c(0, data, split), data + split, len - split);
+	if (crc != expected) {
+		std::cout << len << " bytes at alignment " << align << " split at " << split << ": " << std::hex << crc << " instead of "
+				<< expected << std::dec << std::endl;
+		failed = true;
+	}
+}
+
+static void testAgainstTable() {
+	std::vector<unsigned char> bytes(4 * LONG_BLOCK + 64);
+	boost::uint32_t seed = 1;
+	for (std::size_t i = 0; i < bytes.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		bytes[i] = (unsigned char) (seed >> 16);
+	}
+	const std::size_t lengths[] = { SHORT_BLOCK - 1, SHORT_BLOCK, SHORT_BLOCK + 1, 2 * SHORT_BLOCK + 13, LONG_BLOCK - 8, LONG_BLOCK - 1,
+			LONG_BLOCK, LONG_BLOCK + 1, LONG_BLOCK + SHORT_BLOCK + 7, 2 * LONG_BLOCK, 4 * LONG_BLOCK };
+	for (std::size_t align = 0; align < 8; align++) {
+		for (std::size_t len = 0; len <= 2 * SHORT_BLOCK + 64; len++) {
+			expectSame(&bytes[align], len, align);
+		}
+		for (std::size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+			expectSame(&bytes[align], lengths[i], align);
+		}
+	}
+}
+
+int main() {
+	testCheckValues();
+	testAgainstTable();
+	std::cout << "crc32c on " << crc32cImplementation() << (failed ? ", test failed" : ", test passed") << std::endl;
+	return failed ? 1 : 0;
+}
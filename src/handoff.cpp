@@ -0,0 +1,352 @@
+/*
+ * handoff.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "handoff.hpp"
+#include "controlschema.hpp"
+#include <boost/format.hpp>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace rtunnel {
+
+const boost::uint32_t handoff_state::MAGIC = 0x5254484f;
+const boost::uint32_t handoff_state::FORMAT_VERSION = 2;
+const int handoff_state::MAX_FDS = 200;
+const boost::uint32_t handoff_state::MAX_STATE = 256 * 1024 * 1024;
+
+static boost::system::error_code lastError() {
+	return boost::system::error_code(errno, boost::system::system_category());
+}
+
+/**
+ * neither side may hang the other one forever.
+ */
+static void setTimeouts(int socketFd) {
+	struct timeval timeout = {10, 0};
+	setsockopt(socketFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void writeFully(int socketFd, const unsigned char* data, std::size_t len, boost::system::error_code& ec) {
+	while (len > 0) {
+		ssize_t n = ::send(socketFd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			ec = n < 0 ? lastError() : boost::asio::error::eof;
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+/**
+ * exactly len bytes: a plain read must not run into the bytes carrying
+ * descriptors, they would be dropped.
+ */
+static void readFully(int socketFd, unsigned char* data, std::size_t len, boost::system::error_code& ec) {
+	while (len > 0) {
+		ssize_t n = ::recv(socketFd, data, len, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			ec = n < 0 ? lastError() : boost::asio::error::eof;
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
+
+static void putU32(std::vector<unsigned char>& out, boost::uint32_t v) {
+	out.resize(out.size() + 4);
+	schema::big_endian<boost::uint32_t>::store(&out[out.size() - 4], v);
+}
+
+static void putU64(std::vector<unsigned char>& out, boost::uint64_t v) {
+	out.resize(out.size() + 8);
+	schema::big_endian<boost::uint64_t>::store(&out[out.size() - 8], v);
+}
+
+static void putBytes(std::vector<unsigned char>& out, const unsigned char* data, std::size_t len) {
+	putU32(out, (boost::uint32_t) len);
+	out.insert(out.end(), data, data + len);
+}
+
+/**
+ * bounds checked reads from the received state.
+ */
+struct state_reader {
+	const std::vector<unsigned char>& data;
+	std::size_t offset;
+	bool ok;
+
+	state_reader(const std::vector<unsigned char>& data) :
+			data(data), offset(0), ok(true) {
+	}
+	bool has(std::size_t len) {
+		ok = ok && data.size() - offset >= len;
+		return ok;
+	}
+	boost::uint32_t u32() {
+		if (!has(4)) {
+			return 0;
+		}
+		offset += 4;
+		return schema::big_endian<boost::uint32_t>::load(&data[offset - 4]);
+	}
+	boost::uint64_t u64() {
+		if (!has(8)) {
+			return 0;
+		}
+		offset += 8;
+		return schema::big_endian<boost::uint64_t>::load(&data[offset - 8]);
+	}
+	void bytes(std::vector<unsigned char>& out) {
+		boost::uint32_t len = u32();
+		if (!has(len)) {
+			return;
+		}
+		out.assign(data.begin() + offset, data.begin() + offset + len);
+		offset += len;
+	}
+};
+
+std::vector<unsigned char> handoff_state::encode() {
+	std::vector<unsigned char> out;
+	putU32(out, (boost::uint32_t) paths.size());
+	for (std::size_t i = 0; i < paths.size(); i++) {
+		const handoff_path& path = paths[i];
+		putBytes(out, (const unsigned char*) path.host.data(), path.host.size());
+		putU32(out, (boost::uint32_t) path.port);
+		putU32(out, (boost::uint32_t) path.fd);
+		putU32(out, path.draining ? 1 : 0);
+		// microseconds, -1 while unmeasured.
+		putU64(out, (boost::uint64_t) (boost::int64_t) (path.srtt * 1000));
+		putU64(out, path.accepted);
+		putU64(out, path.refused);
+		putU32(out, path.frameChecksum ? 1 : 0);
+		putU32(out, path.checksumRequired ? 1 : 0);
+		putBytes(out, path.inbound.empty() ? NULL : &path.inbound[0], path.inbound.size());
+	}
+	putU32(out, (boost::uint32_t) streams.size());
+	for (std::size_t i = 0; i < streams.size(); i++) {
+		putU32(out, (boost::uint32_t) streams[i].path);
+		putU32(out, streams[i].stream);
+		putU32(out, (boost::uint32_t) streams[i].fd);
+		putBytes(out, streams[i].outbound.empty() ? NULL : &streams[i].outbound[0], streams[i].outbound.size());
+	}
+	return out;
+}
+
+bool handoff_state::decode(const std::vector<unsigned char>& data) {
+	state_reader in(data);
+	boost::uint32_t pathCount = in.u32();
+	for (boost::uint32_t i = 0; i < pathCount && in.ok; i++) {
+		handoff_path path;
+		std::vector<unsigned char> host;
+		in.bytes(host);
+		path.host.assign(host.begin(), host.end());
+		path.port = (int) in.u32();
+		path.fd = (int) in.u32();
+		path.draining = in.u32() != 0;
+		path.srtt = (boost::int64_t) in.u64() / 1000.0;
+		path.accepted = (unsigned long) in.u64();
+		path.refused = (unsigned long) in.u64();
+		path.frameChecksum = in.u32() != 0;
+		path.checksumRequired = in.u32() != 0;
+		in.bytes(path.inbound);
+		if (path.fd < 0 || path.fd >= (int) fds.size()) {
+			return false;
+		}
+		paths.push_back(path);
+	}
+	boost::uint32_t streamCount = in.u32();
+	for (boost::uint32_t i = 0; i < streamCount && in.ok; i++) {
+		handoff_stream stream;
+		stream.path = (int) in.u32();
+		stream.stream = in.u32();
+		stream.fd = (int) in.u32();
+		in.bytes(stream.outbound);
+		if (stream.path < 0 || stream.path >= (int) paths.size() || stream.fd < 0 || stream.fd >= (int) fds.size()) {
+			return false;
+		}
+		streams.push_back(stream);
+	}
+	return in.ok && in.offset == data.size();
+}
+
+void handoff_state::send(int socketFd, boost::system::error_code& ec) {
+	setTimeouts(socketFd);
+	std::vector<unsigned char> state = this->encode();
+	std::vector<unsigned char> header;
+	putU32(header, MAGIC);
+	putU32(header, FORMAT_VERSION);
+	putU32(header, (boost::uint32_t) state.size());
+	putU32(header, (boost::uint32_t) fds.size());
+	header.insert(header.end(), state.begin(), state.end());
+	writeFully(socketFd, &header[0], header.size(), ec);
+	for (std::size_t sent = 0; sent < fds.size() && !ec; sent += MAX_FDS) {
+		std::size_t n = std::min(fds.size() - sent, (std::size_t) MAX_FDS);
+		char batch = 'F';
+		iovec iov;
+		iov.iov_base = &batch;
+		iov.iov_len = 1;
+		std::vector<char> control(CMSG_SPACE(n * sizeof(int)));
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(n * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fds[sent], n * sizeof(int));
+		ssize_t written = ::sendmsg(socketFd, &msg, MSG_NOSIGNAL);
+		if (written != 1) {
+			ec = written < 0 ? lastError() : boost::asio::error::eof;
+		}
+	}
+}
+
+void handoff_state::receive(int socketFd, boost::system::error_code& ec) {
+	setTimeouts(socketFd);
+	unsigned char header[16];
+	readFully(socketFd, header, sizeof(header), ec);
+	if (ec) {
+		return;
+	}
+	if (schema::big_endian<boost::uint32_t>::load(header) != MAGIC
+			|| schema::big_endian<boost::uint32_t>::load(header + 4) != FORMAT_VERSION) {
+		ec = boost::system::errc::make_error_code(boost::system::errc::protocol_not_supported);
+		return;
+	}
+	boost::uint32_t stateLen = schema::big_endian<boost::uint32_t>::load(header + 8);
+	boost::uint32_t fdCount = schema::big_endian<boost::uint32_t>::load(header + 12);
+	if (stateLen > MAX_STATE) {
+		ec = boost::system::errc::make_error_code(boost::system::errc::message_size);
+		return;
+	}
+	std::vector<unsigned char> state(stateLen);
+	if (stateLen > 0) {
+		readFully(socketFd, &state[0], stateLen, ec);
+	}
+	while (!ec && fds.size() < fdCount) {
+		std::size_t n = std::min((std::size_t) (fdCount - fds.size()), (std::size_t) MAX_FDS);
+		char batch;
+		iovec iov;
+		iov.iov_base = &batch;
+		iov.iov_len = 1;
+		std::vector<char> control(CMSG_SPACE(n * sizeof(int)));
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+		ssize_t got = ::recvmsg(socketFd, &msg, MSG_CMSG_CLOEXEC);
+		if (got != 1) {
+			ec = got < 0 ? lastError() : boost::asio::error::eof;
+			break;
+		}
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || (msg.msg_flags & MSG_CTRUNC)) {
+			ec = boost::system::errc::make_error_code(boost::system::errc::bad_message);
+			break;
+		}
+		std::size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int* data = (int*) CMSG_DATA(cmsg);
+		fds.insert(fds.end(), data, data + received);
+	}
+	if (!ec && !this->decode(state)) {
+		ec = boost::system::errc::make_error_code(boost::system::errc::bad_message);
+	}
+	if (ec) {
+		this->closeAll();
+		paths.clear();
+		streams.clear();
+	}
+}
+
+int handoff_state::take(int i) {
+	int fd = fds[i];
+	fds[i] = -1;
+	return fd;
+}
+
+void handoff_state::closeAll() {
+	for (std::size_t i = 0; i < fds.size(); i++) {
+		if (fds[i] >= 0) {
+			::close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+}
+
+std::string handoff_state::toString() {
+	return str(boost::format("%1% paths, %2% streams, %3% descriptors") % paths.size() % streams.size() % fds.size());
+}
+
+static bool unixAddress(const std::string& path, sockaddr_un& addr, boost::system::error_code& ec) {
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		ec = boost::system::errc::make_error_code(boost::system::errc::filename_too_long);
+		return false;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size());
+	return true;
+}
+
+int handoff_state::listen(const std::string& path, boost::system::error_code& ec) {
+	sockaddr_un addr;
+	if (!unixAddress(path, addr, ec)) {
+		return -1;
+	}
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		ec = lastError();
+		return -1;
+	}
+	::unlink(path.c_str());
+	// owner only before anyone can connect: a peer gets our descriptors.
+	if (::bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0 || ::chmod(path.c_str(), 0600) != 0 || ::listen(fd, 1) != 0) {
+		ec = lastError();
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int handoff_state::connect(const std::string& path, boost::system::error_code& ec) {
+	sockaddr_un addr;
+	if (!unixAddress(path, addr, ec)) {
+		return -1;
+	}
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		ec = lastError();
+		return -1;
+	}
+	if (::connect(fd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+		ec = lastError();
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+} /* namespace rtunnel */
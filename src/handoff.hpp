@@ -0,0 +1,94 @@
+/*
+ * handoff.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef HANDOFF_HPP_
+#define HANDOFF_HPP_
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/cstdint.hpp>
+
+namespace rtunnel {
+
+/**
+ * a tunnel path as handed over; fd is a position in handoff_state::fds.
+ */
+struct handoff_path {
+	std::string host;
+	int port;
+	int fd;
+	bool draining;
+	double srtt;
+	unsigned long accepted;
+	unsigned long refused;
+	// the frame checksum as negotiated, the new process does not ask again
+	bool frameChecksum;
+	bool checksumRequired;
+	// bytes read from the tunnel that do not make a whole frame yet
+	std::vector<unsigned char> inbound;
+};
+
+/**
+ * a backend stream as handed over; path is a position in
+ * handoff_state::paths, fd one in handoff_state::fds.
+ */
+struct handoff_stream {
+	int path;
+	unsigned int stream;
+	int fd;
+	// read from the backend, not yet sent through the tunnel
+	std::vector<unsigned char> outbound;
+};
+
+/**
+ * the live tunnel, passed from a client process to the one replacing it
+ * over a unix socket. The tunnel and backend sockets go along as
+ * SCM_RIGHTS, so an upgrade resets no connection.
+ *
+ * On the wire: magic, version, state length and descriptor count as
+ * big endian u32, the state, then the descriptors in batches of at most
+ * MAX_FDS, each batch riding on one byte.
+ */
+class handoff_state {
+public:
+	static const boost::uint32_t MAGIC;
+	static const boost::uint32_t FORMAT_VERSION;
+
+	void send(int socketFd, boost::system::error_code& ec);
+	void receive(int socketFd, boost::system::error_code& ec);
+	/**
+	 * take descriptor i over, it is not closed by closeAll() any more.
+	 */
+	int take(int i);
+	/**
+	 * close the descriptors nobody took.
+	 */
+	void closeAll();
+	std::string toString();
+
+	/**
+	 * unix socket a client serves handoffs on, replacing whatever is at
+	 * path: the process being replaced may still have it open. Only our
+	 * user may connect to it.
+	 */
+	static int listen(const std::string& path, boost::system::error_code& ec);
+	static int connect(const std::string& path, boost::system::error_code& ec);
+
+	std::vector<handoff_path> paths;
+	std::vector<handoff_stream> streams;
+	std::vector<int> fds;
+private:
+	static const int MAX_FDS;
+	static const boost::uint32_t MAX_STATE;
+
+	std::vector<unsigned char> encode();
+	bool decode(const std::vector<unsigned char>& data);
+};
+
+} /* namespace rtunnel */
+#endif /* HANDOFF_HPP_ */
@@ -0,0 +1,301 @@
+/*
+ * handofftest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "handoff.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace rtunnel;
+
+/**
+ * handoff states over a socketpair: one with more descriptors than fit a
+ * batch comes out as it went in, every descriptor still the same pipe;
+ * cut short, with a wrong magic or version, or with state not matching
+ * its descriptors, receive() fails and keeps nothing.
+ */
+static const int PIPES = 401;
+static const int HEADER_SIZE = 16;
+
+static bool failed = false;
+
+static void fail(const std::string& what) {
+	std::cout << what << std::endl;
+	failed = true;
+}
+
+static void socketPair(int fds[2]) {
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		std::cout << "socketpair failed" << std::endl;
+		_exit(1);
+	}
+}
+
+static handoff_state makeState(const std::vector<int>& fds) {
+	handoff_state state;
+	state.fds = fds;
+	for (int i = 0; i < 2; i++) {
+		handoff_path path;
+		path.host = i == 0 ? "transit-a.example" : "";
+		path.port = 7000 + i;
+		path.fd = i;
+		path.draining = i == 1;
+		path.srtt = i == 0 ? 12.5 : -1;
+		path.accepted = 100000 + i;
+		path.refused = 7;
+		path.frameChecksum = true;
+		path.checksumRequired = i == 0;
+		for (int k = 0; k < 11 * i; k++) {
+			path.inbound.push_back((unsigned char) k);
+		}
+		state.paths.push_back(path);
+	}
+	for (std::size_t i = 2; i < fds.size(); i++) {
+		handoff_stream stream;
+		stream.path = (int) (i % 2);
+		stream.stream = (unsigned int) (i * 3);
+		stream.fd = (int) i;
+		stream.outbound.assign(i % 5, (unsigned char) i);
+		state.streams.push_back(stream);
+	}
+	return state;
+}
+
+static bool samePath(const handoff_path& a, const handoff_path& b) {
+	return a.host == b.host && a.port == b.port && a.fd == b.fd && a.draining == b.draining && a.srtt == b.srtt
+			&& a.accepted == b.accepted && a.refused == b.refused && a.frameChecksum == b.frameChecksum
+			&& a.checksumRequired == b.checksumRequired && a.inbound == b.inbound;
+}
+
+static bool sameStream(const handoff_stream& a, const handoff_stream& b) {
+	return a.path == b.path && a.stream == b.stream && a.fd == b.fd && a.outbound == b.outbound;
+}
+
+/**
+ * the write ends of PIPES pipes go over; a byte written to each one
+ * received has to come out of the read end of the same pipe.
+ */
+static void testRoundTrip() {
+	std::vector<int> readEnds;
+	std::vector<int> writeEnds;
+	for (int i = 0; i < PIPES; i++) {
+		int ends[2];
+		if (pipe(ends) != 0) {
+			fail("pipe failed");
+			return;
+		}
+		readEnds.push_back(ends[0]);
+		writeEnds.push_back(ends[1]);
+	}
+	handoff_state sent = makeState(writeEnds);
+	int pair[2];
+	socketPair(pair);
+	boost::system::error_code ec;
+	sent.send(pair[0], ec);
+	if (ec) {
+		fail("send failed: " + ec.message());
+		return;
+	}
+	// in flight now, the received ones are the only write ends left.
+	sent.closeAll();
+	handoff_state received;
+	received.receive(pair[1], ec);
+	if (ec) {
+		fail("receive failed: " + ec.message());
+		return;
+	}
+	if (received.fds.size() != (std::size_t) PIPES || received.paths.size() != sent.paths.size()
+			|| received.streams.size() != sent.streams.size()) {
+		fail("received " + received.toString() + " instead of " + sent.toString());
+		return;
+	}
+	for (std::size_t i = 0; i < sent.paths.size(); i++) {
+		if (!samePath(sent.paths[i], received.paths[i])) {
+			fail("a path changed on the way");
+		}
+	}
+	for (std::size_t i = 0; i < sent.streams.size(); i++) {
+		if (!sameStream(sent.streams[i], received.streams[i])) {
+			fail("a stream changed on the way");
+		}
+	}
+	for (int i = 0; i < PIPES; i++) {
+		if ((fcntl(received.fds[i], F_GETFD) & FD_CLOEXEC) == 0) {
+			fail("a received descriptor is inherited by children");
+		}
+		unsigned char b = (unsigned char) i;
+		unsigned char got = 0;
+		if (write(received.fds[i], &b, 1) != 1 || read(readEnds[i], &got, 1) != 1 || got != b) {
+			fail("descriptors came out of order");
+			break;
+		}
+	}
+	// the first one is taken, closeAll() leaves it open.
+	int taken = received.take(0);
+	received.closeAll();
+	unsigned char b = 0;
+	if (write(taken, &b, 1) != 1) {
+		fail("closeAll() closed a descriptor that was taken");
+	}
+	for (int i = 1; i < PIPES; i++) {
+		if (read(readEnds[i], &b, 1) != 0) {
+			fail("closeAll() left a descriptor open");
+			break;
+		}
+	}
+	close(taken);
+	for (int i = 0; i < PIPES; i++) {
+		close(readEnds[i]);
+	}
+	close(pair[0]);
+	close(pair[1]);
+}
+
+/**
+ * what send() puts on the wire for a state with two paths on two
+ * descriptors, up to the batch carrying them.
+ */
+static std::vector<unsigned char> wireBytes() {
+	std::vector<int> fds;
+	fds.push_back(open("/dev/null", O_RDONLY));
+	fds.push_back(open("/dev/null", O_RDONLY));
+	handoff_state state = makeState(fds);
+	int pair[2];
+	socketPair(pair);
+	boost::system::error_code ec;
+	state.send(pair[0], ec);
+	state.closeAll();
+	close(pair[0]);
+	std::vector<unsigned char> bytes;
+	unsigned char buffer[4096];
+	ssize_t n;
+	while ((n = read(pair[1], buffer, sizeof(buffer))) > 0) {
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	}
+	close(pair[1]);
+	if (!bytes.empty() && bytes.back() == 'F') {
+		bytes.pop_back();
+	}
+	return bytes;
+}
+
+static void sendBatch(int socketFd, int descriptors) {
+	std::vector<int> fds;
+	for (int i = 0; i < descriptors; i++) {
+		fds.push_back(open("/dev/null", O_RDONLY));
+	}
+	char batch = 'F';
+	iovec iov;
+	iov.iov_base = &batch;
+	iov.iov_len = 1;
+	std::vector<char> control(CMSG_SPACE(descriptors * sizeof(int)));
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (descriptors > 0) {
+		msg.msg_control = &control[0];
+		msg.msg_controllen = control.size();
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(descriptors * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fds[0], descriptors * sizeof(int));
+	}
+	if (sendmsg(socketFd, &msg, 0) != 1) {
+		fail("sendmsg to the socketpair failed");
+	}
+	for (int i = 0; i < descriptors; i++) {
+		close(fds[i]);
+	}
+}
+
+/**
+ * feed bytes to receive(), then a batch of that many descriptors if
+ * batch is set; the peer is gone after.
+ */
+static boost::system::error_code receiveBytes(const std::vector<unsigned char>& bytes, bool batch, int descriptors,
+		handoff_state& state) {
+	int pair[2];
+	socketPair(pair);
+	if (!bytes.empty() && write(pair[0], &bytes[0], bytes.size()) != (ssize_t) bytes.size()) {
+		fail("write to the socketpair failed");
+	}
+	if (batch) {
+		sendBatch(pair[0], descriptors);
+	}
+	close(pair[0]);
+	boost::system::error_code ec;
+	state.receive(pair[1], ec);
+	close(pair[1]);
+	return ec;
+}
+
+static void expectRejected(const std::vector<unsigned char>& bytes, bool batch, int descriptors, const std::string& what) {
+	handoff_state state;
+	boost::system::error_code ec = receiveBytes(bytes, batch, descriptors, state);
+	if (!ec) {
+		fail(what + " was accepted");
+	} else if (!state.paths.empty() || !state.streams.empty()) {
+		fail(what + " left paths or streams behind");
+	}
+	for (std::size_t i = 0; i < state.fds.size(); i++) {
+		if (state.fds[i] >= 0) {
+			fail(what + " left a descriptor open");
+			break;
+		}
+	}
+}
+
+static void testRejected() {
+	std::vector<unsigned char> bytes = wireBytes();
+	if (bytes.size() <= (std::size_t) HEADER_SIZE || bytes[15] != 2) {
+		fail("unexpected wire format");
+		return;
+	}
+	handoff_state state;
+	if (receiveBytes(bytes, true, 2, state) || state.paths.size() != 2) {
+		fail("the untouched wire bytes were rejected");
+	}
+	state.closeAll();
+	// every cut: in the header, in the state, the batch missing.
+	for (std::size_t len = 0; len <= bytes.size(); len++) {
+		expectRejected(std::vector<unsigned char>(bytes.begin(), bytes.begin() + len), false, 0, "a handoff cut short");
+	}
+	expectRejected(bytes, true, 1, "a batch short of a descriptor");
+	expectRejected(bytes, true, 0, "a batch without descriptors");
+	std::vector<unsigned char> bad(bytes);
+	bad[0] ^= 0x01;
+	expectRejected(bad, true, 2, "a wrong magic");
+	bad = bytes;
+	bad[7] = (unsigned char) (handoff_state::FORMAT_VERSION + 1);
+	expectRejected(bad, true, 2, "a newer version");
+	bad = bytes;
+	bad[7] = (unsigned char) (handoff_state::FORMAT_VERSION - 1);
+	expectRejected(bad, true, 2, "an older version");
+	bad = bytes;
+	bad[8] = 0xff;
+	expectRejected(bad, true, 2, "an oversized state");
+	// paths on descriptors that never come.
+	bad = bytes;
+	bad[15] = 0;
+	expectRejected(bad, false, 0, "a state without its descriptors");
+	// one byte more than the state holds.
+	bad = bytes;
+	bad[11]++;
+	bad.push_back(0);
+	expectRejected(bad, true, 2, "a state with trailing bytes");
+}
+
+int main() {
+	testRoundTrip();
+	testRejected();
+	std::cout << (failed ? "handoff test failed" : "handoff test passed") << std::endl;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * ioengine.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "ioengine.hpp"
+#include "asioioengine.hpp"
+#include "uringioengine.hpp"
+#include <log4cpp/Category.hh>
+
+namespace rtunnel {
+
+static log4cpp::Category& logger = log4cpp::Category::getInstance(std::string("rtunnel.io_engine"));
+
+boost::shared_ptr<io_engine> io_engine::create(const std::string& name, boost::asio::io_service& io_service, packet_pool& pool) {
+	if (name == "uring") {
+		boost::shared_ptr<io_engine> engine = uring_io_engine::create(pool);
+		if (engine.get() != NULL) {
+			return engine;
+		}
+		logger.warn("io_uring is not available, falling back to the asio engine.");
+	}
+	return boost::shared_ptr<io_engine>(new asio_io_engine(io_service, pool));
+}
+
+io_engine::~io_engine() {
+}
+
+} /* namespace rtunnel */
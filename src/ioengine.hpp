@@ -0,0 +1,81 @@
+/*
+ * ioengine.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef IOENGINE_HPP_
+#define IOENGINE_HPP_
+
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/smart_ptr.hpp>
+#include "packetpool.hpp"
+
+namespace rtunnel {
+
+/**
+ * I/O engine for stream descriptors: the tunnel socket and the local
+ * backend connections.
+ *
+ * Descriptors are stream sockets, pipes or eventfds. The engine owns the
+ * descriptors handed to watch() and closes them on
+ * unwatch() / stop(). Data read is passed to the read handler, which must
+ * consume it before returning; a handler call with an error code (eof
+ * included) is the last one for that descriptor.
+ *
+ * Apart from post() and stop(), all calls must be made from the thread
+ * inside run(), i.e. from the handlers, or before run() is entered.
+ *
+ * pauseReads() stops reading a descriptor until resumeReads(); data already
+ * in flight may still be delivered after the pause.
+ *
+ * The ticker is the engine's one periodic timer, it drives the timer wheel
+ * of the thread. It only runs while descriptors are watched.
+ */
+class io_engine {
+public:
+	typedef boost::function<void(int fd, const unsigned char* data, std::size_t len, const boost::system::error_code& ec)> read_handler;
+	typedef boost::function<void(int fd, std::size_t queued)> write_handler;
+
+	virtual void watch(int fd, read_handler handler) = 0;
+	virtual void unwatch(int fd) = 0;
+	/**
+	 * stop watching fd but leave it open, e.g. to pass it to another
+	 * process. Reads in flight are cancelled, data they already took still
+	 * goes to the read handler; released is called on the engine thread
+	 * after that. Writes not yet accepted by the kernel are dropped.
+	 */
+	virtual void release(int fd, boost::function<void()> released) = 0;
+	virtual void write(int fd, const unsigned char* data, std::size_t len) = 0;
+	virtual void pauseReads(int fd) = 0;
+	virtual void resumeReads(int fd) = 0;
+	/**
+	 * @return bytes given to write() and not yet accepted by the kernel.
+	 */
+	virtual std::size_t getQueuedBytes(int fd) = 0;
+	/**
+	 * call handler each time the kernel has accepted a write to fd, with
+	 * the bytes still queued; an empty handler removes it. The handler
+	 * goes away with the descriptor.
+	 */
+	virtual void setWriteHandler(int fd, write_handler handler) = 0;
+	virtual void post(boost::function<void()> handler) = 0;
+	virtual void setTicker(int intervalMs, boost::function<void()> handler) = 0;
+	virtual void run() = 0;
+	virtual void stop() = 0;
+	virtual std::string getName() = 0;
+
+	/**
+	 * create the engine called name ("asio" or "uring"), falling back to
+	 * asio when the requested one is not available on this system.
+	 */
+	static boost::shared_ptr<io_engine> create(const std::string& name, boost::asio::io_service& io_service, packet_pool& pool);
+
+	virtual ~io_engine();
+};
+
+} /* namespace rtunnel */
+#endif /* IOENGINE_HPP_ */
@@ -6,6 +6,8 @@
  */
 
 #include "clientbootstrap.hpp"
+#include "replay.hpp"
+#include <iostream>
 #include <log4cpp/PropertyConfigurator.hh>
 
 int main(int ac, char* av[]) {
@@ -13,6 +15,20 @@ int main(int ac, char* av[]) {
 	std::string initFileName = "log4cpp.properties";
 	log4cpp::PropertyConfigurator::configure(initFileName);
 
+	rtunnel::client_config config;
+	config.init(ac, av);
+	if (!config.replayFile.empty()) {
+		rtunnel::frame_replay replay(config.replayFile, config.replayTiming == "original", config.replayLoops);
+		boost::system::error_code ec;
+		replay.run(ec);
+		if (ec) {
+			std::cout << "replay of " << config.replayFile << " fails: " << ec.message() << std::endl;
+			return 1;
+		}
+		std::cout << replay.toString() << std::endl;
+		return 0;
+	}
+
 	rtunnel::client_bootstrap bootstrap(ac, av);
 	bootstrap.start();
 
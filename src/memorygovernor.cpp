@@ -0,0 +1,117 @@
+/*
+ * memorygovernor.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "memorygovernor.hpp"
+#include <algorithm>
+#include <boost/format.hpp>
+
+namespace rtunnel {
+
+log4cpp::Category& memory_governor::logger = log4cpp::Category::getInstance(std::string("rtunnel.memory_governor"));
+
+governed_stream::~governed_stream() {
+}
+
+static bool heavier(const std::pair<std::size_t, governed_stream*>& a, const std::pair<std::size_t, governed_stream*>& b) {
+	return a.first > b.first;
+}
+
+memory_governor::memory_governor() :
+		buffered(0), peak(0), budget(0) {
+}
+
+memory_governor& memory_governor::instance() {
+	static memory_governor governor;
+	return governor;
+}
+
+/**
+ * @param bytes 0 for no limit.
+ */
+void memory_governor::setBudget(std::size_t bytes) {
+	boost::mutex::scoped_lock lock(mutex);
+	this->budget = bytes;
+}
+
+void memory_governor::charge(std::size_t bytes) {
+	std::size_t now = buffered.fetch_add(bytes, boost::memory_order_relaxed) + bytes;
+	std::size_t high = peak.load(boost::memory_order_relaxed);
+	while (now > high && !peak.compare_exchange_weak(high, now, boost::memory_order_relaxed)) {
+	}
+}
+
+void memory_governor::credit(std::size_t bytes) {
+	buffered.fetch_sub(bytes, boost::memory_order_relaxed);
+}
+
+void memory_governor::attach(governed_stream* stream) {
+	boost::mutex::scoped_lock lock(mutex);
+	streams.push_back(stream);
+}
+
+void memory_governor::detach(governed_stream* stream) {
+	boost::mutex::scoped_lock lock(mutex);
+	streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+	paused.erase(stream);
+}
+
+void memory_governor::enforce() {
+	boost::mutex::scoped_lock lock(mutex);
+	std::size_t used = buffered.load(boost::memory_order_relaxed);
+	if (budget > 0 && used > budget) {
+		std::vector<std::pair<std::size_t, governed_stream*> > candidates;
+		for (std::size_t i = 0; i < streams.size(); i++) {
+			if (paused.find(streams[i]) == paused.end()) {
+				candidates.push_back(std::make_pair(streams[i]->getBufferedBytes(), streams[i]));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), heavier);
+		std::size_t projected = used;
+		std::size_t target = budget / 10 * 9;
+		for (std::size_t i = 0; i < candidates.size() && projected > target && candidates[i].first > 0; i++) {
+			candidates[i].second->pauseReads();
+			paused.insert(candidates[i].second);
+			projected -= std::min(projected, candidates[i].first);
+		}
+		if (!candidates.empty()) {
+			logger.warn(str(boost::format("over memory budget, %1%") % this->toString()));
+		}
+	} else if (!paused.empty() && (budget == 0 || used < budget / 4 * 3)) {
+		for (std::set<governed_stream*>::iterator it = paused.begin(); it != paused.end(); ++it) {
+			(*it)->resumeReads();
+		}
+		paused.clear();
+	}
+	for (std::size_t i = 0; i < streams.size(); i++) {
+		if (streams[i]->getBufferedBytes() == 0) {
+			streams[i]->trimBuffers();
+		}
+	}
+}
+
+std::size_t memory_governor::getBuffered() {
+	return buffered.load(boost::memory_order_relaxed);
+}
+
+std::size_t memory_governor::getPeak() {
+	return peak.load(boost::memory_order_relaxed);
+}
+
+std::size_t memory_governor::getBudget() {
+	return budget;
+}
+
+std::size_t memory_governor::getPaused() {
+	return paused.size();
+}
+
+std::string memory_governor::toString() {
+	return str(boost::format("buffered=%1% peak=%2% budget=%3% streams=%4% paused=%5%")
+			% getBuffered() % getPeak() % budget % streams.size() % paused.size());
+}
+
+} /* namespace rtunnel */
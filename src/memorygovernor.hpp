@@ -0,0 +1,85 @@
+/*
+ * memorygovernor.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef MEMORYGOVERNOR_HPP_
+#define MEMORYGOVERNOR_HPP_
+
+#include <set>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <log4cpp/Category.hh>
+
+namespace rtunnel {
+
+/**
+ * something that buffers payload read from a socket, or has it buffered
+ * further on, and can stop reading.
+ */
+class governed_stream {
+public:
+	virtual std::size_t getBufferedBytes() = 0;
+	virtual void pauseReads() = 0;
+	virtual void resumeReads() = 0;
+	/**
+	 * give back buffer capacity left over from a burst.
+	 */
+	virtual void trimBuffers() = 0;
+	virtual ~governed_stream();
+};
+
+/**
+ * process wide account of buffered payload bytes.
+ *
+ * Buffers charge() and credit() what they hold, from any thread; the io
+ * engines do so for their write queues. enforce()
+ * runs periodically on the io thread: above the budget it pauses reads on
+ * the streams holding the most until the projected usage is back under 90%
+ * of it, and resumes them once usage falls under 75%. Streams with nothing
+ * buffered are asked to trim their buffers.
+ */
+class memory_governor {
+public:
+	static memory_governor& instance();
+
+	void setBudget(std::size_t bytes);
+	void charge(std::size_t bytes);
+	void credit(std::size_t bytes);
+	void attach(governed_stream* stream);
+	void detach(governed_stream* stream);
+	void enforce();
+
+	std::size_t getBuffered();
+	std::size_t getPeak();
+	std::size_t getBudget();
+	std::size_t getPaused();
+	std::string toString();
+private:
+	static log4cpp::Category& logger;
+
+	boost::atomic<std::size_t> buffered;
+	boost::atomic<std::size_t> peak;
+	std::size_t budget;
+	boost::mutex mutex;
+	std::vector<governed_stream*> streams;
+	std::set<governed_stream*> paused;
+
+	memory_governor();
+};
+
+/**
+ * shrink v if it holds less than a quarter of a capacity above 64KB; the
+ * usual copy-and-swap, as shrink_to_fit is only a request.
+ */
+inline void trimBuffer(std::vector<unsigned char>& v) {
+	if (v.capacity() > 65536 && v.size() < v.capacity() / 4) {
+		std::vector<unsigned char>(v).swap(v);
+	}
+}
+
+} /* namespace rtunnel */
+#endif /* MEMORYGOVERNOR_HPP_ */
@@ -0,0 +1,143 @@
+/*
+ * mpscqueue.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef MPSCQUEUE_HPP_
+#define MPSCQUEUE_HPP_
+
+#include <cstddef>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rtunnel {
+
+/**
+ * bounded lock-free multi-producer / single-consumer queue.
+ *
+ * Every cell carries a sequence number telling whether it is free for the
+ * producer claiming position pos (sequence == pos) or holds an element for
+ * the consumer (sequence == pos + 1). Producers only contend on one
+ * compare-and-swap of the enqueue position; the consumer never uses an
+ * atomic read-modify-write.
+ *
+ * tryPush() may be called from any thread, tryPop()/popBatch() only from
+ * the one consumer thread.
+ */
+template<typename T>
+class mpsc_queue: private boost::noncopyable {
+public:
+	explicit mpsc_queue(std::size_t capacity) :
+			enqueuePos(0), dequeuePos(0), rejected(0) {
+		std::size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		this->cells = new cell[size];
+		this->mask = size - 1;
+		for (std::size_t i = 0; i < size; i++) {
+			cells[i].sequence.store(i, boost::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @return false if the queue is full, the element is not queued and
+	 *         the caller keeps it.
+	 */
+	bool tryPush(const T& value) {
+		cell* c;
+		std::size_t pos = enqueuePos.load(boost::memory_order_relaxed);
+		for (;;) {
+			c = &cells[pos & mask];
+			std::size_t seq = c->sequence.load(boost::memory_order_acquire);
+			std::ptrdiff_t diff = (std::ptrdiff_t) seq - (std::ptrdiff_t) pos;
+			if (diff == 0) {
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+					break;
+				}
+			} else if (diff < 0) {
+				rejected.fetch_add(1, boost::memory_order_relaxed);
+				return false;
+			} else {
+				pos = enqueuePos.load(boost::memory_order_relaxed);
+			}
+		}
+		c->value = value;
+		c->sequence.store(pos + 1, boost::memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& value) {
+		std::size_t pos = dequeuePos.load(boost::memory_order_relaxed);
+		cell* c = &cells[pos & mask];
+		if (c->sequence.load(boost::memory_order_acquire) != pos + 1) {
+			return false;
+		}
+		value = c->value;
+		c->sequence.store(pos + mask + 1, boost::memory_order_release);
+		dequeuePos.store(pos + 1, boost::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * pop up to max elements into out.
+	 *
+	 * @return number of elements popped.
+	 */
+	std::size_t popBatch(T* out, std::size_t max) {
+		std::size_t n = 0;
+		while (n < max && tryPop(out[n])) {
+			n++;
+		}
+		return n;
+	}
+
+	/**
+	 * @return approximate number of queued elements, exact when no push or
+	 *         pop is in progress.
+	 */
+	std::size_t getDepth() {
+		std::size_t head = dequeuePos.load(boost::memory_order_relaxed);
+		std::size_t tail = enqueuePos.load(boost::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+
+	std::size_t getCapacity() {
+		return mask + 1;
+	}
+
+	unsigned long getPushed() {
+		return enqueuePos.load(boost::memory_order_relaxed);
+	}
+
+	unsigned long getPopped() {
+		return dequeuePos.load(boost::memory_order_relaxed);
+	}
+
+	unsigned long getRejected() {
+		return rejected.load(boost::memory_order_relaxed);
+	}
+
+	virtual ~mpsc_queue() {
+		delete[] cells;
+	}
+private:
+	struct cell {
+		boost::atomic<std::size_t> sequence;
+		T value;
+	};
+	// producers and the consumer write different lines.
+	cell* cells;
+	std::size_t mask;
+	char pad0[64];
+	boost::atomic<std::size_t> enqueuePos;
+	char pad1[64];
+	boost::atomic<std::size_t> dequeuePos;
+	char pad2[64];
+	boost::atomic<unsigned long> rejected;
+};
+
+} /* namespace rtunnel */
+#endif /* MPSCQUEUE_HPP_ */
@@ -0,0 +1,79 @@
+/*
+ * mpscqueuetest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "mpscqueue.hpp"
+#include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace rtunnel;
+
+/**
+ * several producers push numbered elements through a small queue while
+ * one consumer pops them; each producer's elements must all come out once,
+ * in the order they went in.
+ */
+static const int PRODUCERS = 4;
+static const unsigned long PER_PRODUCER = 500000;
+static const std::size_t CAPACITY = 1024;
+static const std::size_t BATCH = 64;
+
+static void produce(mpsc_queue<unsigned long long>& queue, int producer) {
+	for (unsigned long i = 0; i < PER_PRODUCER; i++) {
+		unsigned long long value = ((unsigned long long) producer << 32) | i;
+		while (!queue.tryPush(value)) {
+			boost::this_thread::yield();
+		}
+	}
+}
+
+int main() {
+	mpsc_queue<unsigned long long> queue(CAPACITY);
+	std::vector<unsigned long> expected(PRODUCERS, 0);
+	boost::thread_group producers;
+	for (int i = 0; i < PRODUCERS; i++) {
+		producers.create_thread(boost::bind(produce, boost::ref(queue), i));
+	}
+
+	unsigned long long total = (unsigned long long) PRODUCERS * PER_PRODUCER;
+	unsigned long long popped = 0;
+	unsigned long long batch[BATCH];
+	bool failed = false;
+	while (popped < total && !failed) {
+		// single pops and batches both.
+		std::size_t n = (popped & 1) ? queue.popBatch(batch, BATCH) : queue.tryPop(batch[0]) ? 1 : 0;
+		if (n == 0) {
+			boost::this_thread::yield();
+			continue;
+		}
+		for (std::size_t i = 0; i < n; i++) {
+			unsigned int producer = (unsigned int) (batch[i] >> 32);
+			unsigned long sequence = (unsigned long) (batch[i] & 0xffffffffUL);
+			if (producer >= (unsigned int) PRODUCERS || sequence != expected[producer]) {
+				std::cout << "producer " << producer << " element " << sequence << " is lost, repeated or out of order" << std::endl;
+				failed = true;
+				break;
+			}
+			expected[producer]++;
+		}
+		popped += n;
+	}
+	producers.join_all();
+
+	unsigned long long value;
+	if (!failed && queue.tryPop(value)) {
+		std::cout << "an element too many" << std::endl;
+		failed = true;
+	}
+	if (!failed && (queue.getPushed() != total || queue.getPopped() != total || queue.getDepth() != 0)) {
+		std::cout << "counters off: " << queue.getPushed() << " pushed, " << queue.getPopped() << " popped" << std::endl;
+		failed = true;
+	}
+	std::cout << popped << " of " << total << " elements, " << queue.getRejected() << " pushes rejected" << std::endl;
+	return failed ? 1 : 0;
+}
@@ -6,6 +6,10 @@
  */
 
 #include "packet.hpp"
+#include "controlschema.hpp"
+#include "crc32c.hpp"
+#include "memorygovernor.hpp"
+#include "probes.hpp"
 #include <exception>
 #include <math.h>
 
@@ -17,6 +21,7 @@ const int packet::HEAD_SIZE = 5;
 const bool packet::DEBUG = false;
 const int packet::BUFFER_MARGIN = 16 + packet::HEAD_SIZE + 32;
 const int packet::CLEAR_PROTOCOL_BIT_MASK = 0xff - packet::PROTOCOL_BIT_MASK;
+const int packet::TRIM_SIZE = 4096;
 
 packet::packet(int size):type(0), index(HEAD_SIZE), readIndex(HEAD_SIZE){
 	if (size >= PACKET_MAX_SIZE) {
@@ -25,7 +30,26 @@ packet::packet(int size):type(0), index(HEAD_SIZE), readIndex(HEAD_SIZE){
 	if (size < 0) {
 		throw new std::invalid_argument(str(boost::format("packet size %1% must not be negtive.") % size));
 	}
+	RTUNNEL_PROBE1(packet_construct, size);
 	this -> bufferVec = std::vector<unsigned char>(size + BUFFER_MARGIN);
+	memory_governor::instance().charge(bufferVec.size());
+}
+
+packet::packet(const packet& other) :
+		bufferVec(other.bufferVec), index(other.index), readIndex(other.readIndex), type(other.type) {
+	memory_governor::instance().charge(bufferVec.size());
+}
+
+packet& packet::operator=(const packet& other) {
+	if (this != &other) {
+		memory_governor::instance().credit(bufferVec.size());
+		this->bufferVec = other.bufferVec;
+		this->index = other.index;
+		this->readIndex = other.readIndex;
+		this->type = other.type;
+		memory_governor::instance().charge(bufferVec.size());
+	}
+	return *this;
 }
 
 void packet::setProtocol(int protocol){
@@ -45,6 +69,13 @@ bool packet::isProtocol(int protocol){
 	return (this->type & PROTOCOL_BIT_MASK) == protocol;
 }
 
+/**
+ * @return the protocol in the low bits of the type, always in [0, 15].
+ */
+int packet::getProtocol(){
+	return this->type & PROTOCOL_BIT_MASK;
+}
+
 void packet::init(int level){
 	// not implemented!
 }
@@ -309,6 +340,7 @@ unsigned char packet::byteAt(int index) {
  * 根据设置的标识位进行压缩、加密等等
  */
 void packet::encode() {
+	RTUNNEL_PROBE2(packet_encode, type, getDataLen());
 	// 先压缩后加密
 	if (isCompressed()) {
 		compress();
@@ -320,8 +352,20 @@ void packet::encode() {
 
 /**
  * 根据标识位进行解密和解压
- */
-void packet::decode() {
+ *
+ * @return false if the frame's checksum does not match, it is left as is.
+ */
+bool packet::decode() {
+	RTUNNEL_PROBE2(packet_decode, type, getDataLen());
+	// the trailer covers the frame as it came, header included.
+	if (isChecksummed()) {
+		if (getDataLen() < 4 || crc32c(0, &bufferVec[0], index - 4) != schema::big_endian<boost::uint32_t>::load(&bufferVec[index - 4])) {
+			RTUNNEL_PROBE2(packet_corrupt, type, getDataLen());
+			return false;
+		}
+		index -= 4;
+		type &= ~CHECKSUMMED;
+	}
 	// 先解密后解压
 	if (isEncrypted()) {
 		decrypt();
@@ -331,6 +375,27 @@ void packet::decode() {
 		uncompress();
 		clearCompressed();
 	}
+	return true;
+}
+
+/**
+ * @return true if the data ends in a crc32c trailer.
+ */
+bool packet::isChecksummed() {
+	return (this->type & CHECKSUMMED) != 0;
+}
+
+/**
+ * seal the frame with a crc32c of header and data, appended to the data.
+ * Call it last, after encode() and right after the data was written,
+ * while it is still in cache; decode() checks and strips it.
+ */
+void packet::appendChecksum() {
+	ensureSize(getDataLen() + 4);
+	type |= CHECKSUMMED;
+	index += 4;
+	fillHeader();
+	schema::big_endian<boost::uint32_t>::store(&bufferVec[index - 4], crc32c(0, &bufferVec[0], index - 4));
 }
 
 void packet::fillHeader() {
@@ -358,7 +423,21 @@ void packet::readHeader() {
 void packet::resize(int size) {
 	std::vector<unsigned char> newBufferVec(size);
 	std::copy(bufferVec.begin(), bufferVec.begin()+index, newBufferVec.begin());
-	this->bufferVec = newBufferVec;
+	memory_governor::instance().charge(newBufferVec.size());
+	memory_governor::instance().credit(bufferVec.size());
+	this->bufferVec.swap(newBufferVec);
+}
+
+/**
+ * give back the space a burst grew the buffer to: shrink to the current
+ * data plus margin, or TRIM_SIZE, whichever is larger, once the buffer is
+ * more than twice that.
+ */
+void packet::trim() {
+	int size = std::max(index + BUFFER_MARGIN, TRIM_SIZE);
+	if ((int) bufferVec.size() > size * 2) {
+		this->resize(size);
+	}
 }
 
 /**
@@ -374,6 +453,7 @@ void packet::ensureSize(int size) {
 		if (resize < size) {
 			throw new std::invalid_argument(str(boost::format("packet size %1%,exceed maximum packet size is %2%") % size % PACKET_MAX_SIZE));
 		}
+		RTUNNEL_PROBE2(packet_grow, (int) bufferVec.size(), resize);
 		this->resize(resize);
 	}
 }
@@ -550,48 +630,72 @@ void packet::readData(std::vector<unsigned char> buf){
 	index += len;
 }
 
-void packet::setControlPacket(packet p, int type, std::vector<unsigned char> resultBytes) {
+/**
+ * clear the body and make room for len bytes of data, which the caller
+ * writes in place.
+ *
+ * @param len
+ * @return where the data starts.
+ */
+unsigned char* packet::reserveData(int len) {
+	clearBody();
+	ensureSize(len);
+	index = HEAD_SIZE + len;
+	return &bufferVec[HEAD_SIZE];
+}
+
+/**
+ * @param offset
+ * @return data area starting at offset.
+ */
+const unsigned char* packet::dataAt(int offset) {
+	return &bufferVec[HEAD_SIZE + offset];
+}
+
+void packet::setControlPacket(packet& p, int type, std::vector<unsigned char> resultBytes) {
 	p.clear();
 	p.setProtocol(type);
 	p.feedBytes(resultBytes);
 }
 
-void packet::setControlPacket(packet p, int type, int intResult) {
+void packet::setControlPacket(packet& p, int type, int intResult) {
 	p.clear();
 	p.setProtocol(type);
 	p.feedInt(intResult);
 }
 
-void packet::setControlPacket(packet p, int type, long longResult) {
+void packet::setControlPacket(packet& p, int type, long longResult) {
 	p.clear();
 	p.setProtocol(type);
 	p.feedLong(longResult);
 }
 
-packet packet::fillHeartBeatPacket(packet p) {
+packet& packet::fillHeartBeatPacket(packet& p) {
 	boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
 	boost::posix_time::time_duration duration( time.time_of_day() );
-	setControlPacket(p, HEART_BEAT, (long)duration.total_milliseconds());
+	heart_beat_message m;
+	m.time = duration.total_milliseconds();
+	schema::encode(p, m);
 	return p;
 }
 
-packet packet::fillACKHeartBeatPacket(packet p, std::vector<unsigned char> timeBytes) {
+packet& packet::fillACKHeartBeatPacket(packet& p, std::vector<unsigned char> timeBytes) {
 	setControlPacket(p, ACK_HEART_BEAT, timeBytes);
 	return p;
 }
 
-packet packet::fillCloseTunnelPacket(packet p) {
-	std::vector<unsigned char> resultBytes(0);
-	setControlPacket(p, CLOSE_TUNNEL, resultBytes);
+packet& packet::fillCloseTunnelPacket(packet& p) {
+	schema::encode(p, close_tunnel_message());
 	return p;
 }
 
-packet packet::fillDHKeyPacket(packet p, int protocol, std::vector<unsigned char> keyBytes) {
+packet& packet::fillDHKeyPacket(packet& p, int protocol, std::vector<unsigned char> keyBytes) {
 	setControlPacket(p, protocol, keyBytes);
 	return p;
 }
 
 packet::~packet() {
+	memory_governor::instance().credit(bufferVec.size());
 }
 
 } /* namespace rtunnel */
@@ -31,12 +31,19 @@ public:
 
 	const static int COMPRESSED = 0x80;
 	const static int ENCRYPTED = 0x40;
+	// the data ends in a crc32c of the frame, see appendChecksum()
+	const static int CHECKSUMMED = 0x20;
 	const static int HIGH_MASK = 0xc0;
+	// data length limit, a checksum trailer comes on top
+	static const int PACKET_MAX_SIZE;
 
 	packet(int size);
+	packet(const packet& other);
+	packet& operator=(const packet& other);
 
 	void setProtocol(int protocol);
 	bool isProtocol(int protocol);
+	int getProtocol();
 
 	int getType();
 	bool isCompressed();
@@ -45,6 +52,8 @@ public:
 	void setEncrypted();
 	void clearEncrypted();
 	void clearCompressed();
+	bool isChecksummed();
+	void appendChecksum();
 	void clearHeader();
 	bool isHeartBeat();
 	void setHeartBeat();
@@ -63,11 +72,12 @@ public:
 	std::vector<unsigned char> toBytes();
 	unsigned char byteAt(int index);
 	void encode();
-	void decode();
+	bool decode();
 	void fillHeader();
 	void readHeader();
 	void resize(int size);
 	void ensureSize(int size);
+	void trim();
 	int getDataLen();
 	void setDataLen(int len);
 	std::string toString();
@@ -78,23 +88,25 @@ public:
 	boost::asio::const_buffer wrapPacket();
 	boost::asio::const_buffer wrapPacketData();
 	void readData(std::vector<unsigned char> buf);
+	unsigned char* reserveData(int len);
+	const unsigned char* dataAt(int offset);
 
-	static void setControlPacket(packet p, int type, std::vector<unsigned char> resultBytes);
-	static void setControlPacket(packet p, int type, int intResult);
-	static void setControlPacket(packet p, int type, long longResult);
-	static packet fillHeartBeatPacket(packet p);
-	static packet fillACKHeartBeatPacket(packet p, std::vector<unsigned char> timeBytes);
-	static packet fillCloseTunnelPacket(packet p);
-	static packet fillDHKeyPacket(packet p, int protocol, std::vector<unsigned char> keyBytes);
+	static void setControlPacket(packet& p, int type, std::vector<unsigned char> resultBytes);
+	static void setControlPacket(packet& p, int type, int intResult);
+	static void setControlPacket(packet& p, int type, long longResult);
+	static packet& fillHeartBeatPacket(packet& p);
+	static packet& fillACKHeartBeatPacket(packet& p, std::vector<unsigned char> timeBytes);
+	static packet& fillCloseTunnelPacket(packet& p);
+	static packet& fillDHKeyPacket(packet& p, int protocol, std::vector<unsigned char> keyBytes);
 
 	virtual ~packet();
 private:
-	static const int PACKET_MAX_SIZE;
 	static const int PROTOCOL_BIT_MASK;
 	static const int HEAD_SIZE;
 	static const bool DEBUG;
 	static const int BUFFER_MARGIN;
 	static const int CLEAR_PROTOCOL_BIT_MASK;
+	static const int TRIM_SIZE;
 	std::vector<unsigned char> bufferVec;
 	int index;
 	int readIndex;
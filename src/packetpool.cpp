@@ -0,0 +1,64 @@
+/*
+ * packetpool.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "packetpool.hpp"
+
+namespace rtunnel {
+
+packet_pool::packet_pool(int bufferSize, int count) :
+		slab((std::size_t) bufferSize * count), bufferSize(bufferSize), count(count) {
+	this->freeList.reserve(count);
+	for (int i = count - 1; i >= 0; i--) {
+		this->freeList.push_back(i);
+	}
+}
+
+/**
+ * take a buffer out of the pool.
+ *
+ * @return buffer index, or -1 if the pool is exhausted.
+ */
+int packet_pool::acquire() {
+	boost::mutex::scoped_lock lock(mutex);
+	if (freeList.empty()) {
+		return -1;
+	}
+	int index = freeList.back();
+	freeList.pop_back();
+	return index;
+}
+
+void packet_pool::release(int index) {
+	boost::mutex::scoped_lock lock(mutex);
+	freeList.push_back(index);
+}
+
+unsigned char* packet_pool::at(int index) {
+	return &slab[(std::size_t) index * bufferSize];
+}
+
+unsigned char* packet_pool::getSlab() {
+	return &slab[0];
+}
+
+int packet_pool::getBufferSize() {
+	return bufferSize;
+}
+
+int packet_pool::getCount() {
+	return count;
+}
+
+int packet_pool::available() {
+	boost::mutex::scoped_lock lock(mutex);
+	return (int) freeList.size();
+}
+
+packet_pool::~packet_pool() {
+}
+
+} /* namespace rtunnel */
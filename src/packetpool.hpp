@@ -0,0 +1,43 @@
+/*
+ * packetpool.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef PACKETPOOL_HPP_
+#define PACKETPOOL_HPP_
+
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace rtunnel {
+
+/**
+ * fixed size packet buffers carved out of one contiguous slab, so the whole
+ * pool can be registered with the kernel in one go. buffers are addressed by
+ * index.
+ */
+class packet_pool {
+public:
+	packet_pool(int bufferSize, int count);
+
+	int acquire();
+	void release(int index);
+	unsigned char* at(int index);
+	unsigned char* getSlab();
+	int getBufferSize();
+	int getCount();
+	int available();
+
+	virtual ~packet_pool();
+private:
+	std::vector<unsigned char> slab;
+	std::vector<int> freeList;
+	int bufferSize;
+	int count;
+	boost::mutex mutex;
+};
+
+} /* namespace rtunnel */
+#endif /* PACKETPOOL_HPP_ */
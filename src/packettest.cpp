@@ -0,0 +1,101 @@
+/*
+ * packettest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "packet.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace rtunnel;
+
+/**
+ * frames sealed by appendChecksum() come through decode() unchanged, and
+ * flipping any one bit of their type, data or trailer gets them rejected.
+ *
+ * The length is left alone: the framing reads exactly that many bytes, so
+ * a wrong one is a different frame. So is the CHECKSUMMED bit, a frame
+ * that lost it decodes as unsealed, which the tunnel refuses once both
+ * sides seal theirs.
+ */
+static const int HEAD_SIZE = 5;
+
+static bool failed = false;
+
+static void fail(const std::string& what) {
+	std::cout << what << std::endl;
+	failed = true;
+}
+
+static std::vector<unsigned char> seal(int protocol, const std::vector<unsigned char>& data) {
+	packet p(data.size() + 4);
+	p.setProtocol(protocol);
+	if (!data.empty()) {
+		p.feedBytes(data);
+	}
+	p.appendChecksum();
+	boost::asio::const_buffer frame = p.wrapPacket();
+	const unsigned char* bytes = boost::asio::buffer_cast<const unsigned char*>(frame);
+	return std::vector<unsigned char>(bytes, bytes + boost::asio::buffer_size(frame));
+}
+
+static bool decode(const std::vector<unsigned char>& frame, std::vector<unsigned char>& data) {
+	packet p(frame.size() - HEAD_SIZE);
+	p.readPacket(frame, frame.size());
+	if (!p.decode()) {
+		return false;
+	}
+	data.assign(p.dataAt(0), p.dataAt(0) + p.getDataLen());
+	return true;
+}
+
+static void testFrame(int protocol, const std::vector<unsigned char>& data) {
+	std::vector<unsigned char> frame = seal(protocol, data);
+	if (frame.size() != HEAD_SIZE + data.size() + 4 || (frame[0] & packet::CHECKSUMMED) == 0) {
+		fail("a sealed frame has no trailer");
+		return;
+	}
+	std::vector<unsigned char> decoded;
+	if (!decode(frame, decoded) || decoded != data) {
+		fail("a sealed frame did not decode to its data");
+		return;
+	}
+	int accepted = 0;
+	for (std::size_t i = 0; i < frame.size(); i++) {
+		if (i >= 1 && i < HEAD_SIZE) {
+			continue;
+		}
+		for (int bit = 0; bit < 8; bit++) {
+			if (i == 0 && (1 << bit) == packet::CHECKSUMMED) {
+				continue;
+			}
+			std::vector<unsigned char> flipped(frame);
+			flipped[i] ^= (unsigned char) (1 << bit);
+			if (decode(flipped, decoded)) {
+				accepted++;
+			}
+		}
+	}
+	if (accepted > 0) {
+		std::cout << accepted << " frames of " << data.size() << " data bytes with one bit flipped were accepted" << std::endl;
+		failed = true;
+	}
+}
+
+int main() {
+	std::vector<unsigned char> data;
+	testFrame(packet::CLOSE_TUNNEL, data);
+	const std::size_t sizes[] = { 1, 4, 7, 8, 9, 100, 1000, 5000 };
+	for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		data.resize(sizes[s]);
+		for (std::size_t i = 0; i < data.size(); i++) {
+			data[i] = (unsigned char) (i * 31 + sizes[s]);
+		}
+		testFrame(packet::DATA, data);
+	}
+	std::cout << (failed ? "packet test failed" : "packet test passed") << std::endl;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * probes.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef PROBES_HPP_
+#define PROBES_HPP_
+
+/**
+ * static tracepoints (usdt) of provider rtunnel, for bpftrace or perf:
+ *
+ *   bpftrace -e 'usdt:./rtunnel-client:rtunnel:frame_send { @[arg1 & 15] = hist(arg2); }'
+ *
+ * A probe is a nop in the code and a note in the binary until a tracer
+ * attaches. Built with sys/sdt.h when it is there (systemtap-sdt-dev),
+ * otherwise, or with -DRTUNNEL_NO_PROBES, the probes compile to nothing
+ * and their arguments are not evaluated.
+ *
+ *   packet_construct  size
+ *   packet_grow       old buffer size, new buffer size
+ *   packet_encode     type, data length
+ *   packet_decode     type, data length
+ *   packet_corrupt    type, data length
+ *   frame_send        path, type, data length, stream
+ *   frame_receive     path, type, data length, stream
+ *   stream_accept     path, stream
+ *   backend_connect   path, stream, errno (0 when connected)
+ *   stream_close      path, stream, 1 if the backend closed it, 2 if reset
+ *   path_reconnect    path, 1 if connected
+ *   heartbeat_rtt     path, rtt in ms
+ */
+
+#if !defined(RTUNNEL_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define RTUNNEL_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef RTUNNEL_HAVE_PROBES
+#define RTUNNEL_PROBE1(name, a) DTRACE_PROBE1(rtunnel, name, a)
+#define RTUNNEL_PROBE2(name, a, b) DTRACE_PROBE2(rtunnel, name, a, b)
+#define RTUNNEL_PROBE3(name, a, b, c) DTRACE_PROBE3(rtunnel, name, a, b, c)
+#define RTUNNEL_PROBE4(name, a, b, c, d) DTRACE_PROBE4(rtunnel, name, a, b, c, d)
+#else
+#define RTUNNEL_PROBE1(name, a) do { (void) sizeof(a); } while (0)
+#define RTUNNEL_PROBE2(name, a, b) do { (void) sizeof(a); (void) sizeof(b); } while (0)
+#define RTUNNEL_PROBE3(name, a, b, c) do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); } while (0)
+#define RTUNNEL_PROBE4(name, a, b, c, d) do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); (void) sizeof(d); } while (0)
+#endif
+
+#endif /* PROBES_HPP_ */
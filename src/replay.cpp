@@ -0,0 +1,212 @@
+/*
+ * replay.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "replay.hpp"
+#include "capture.hpp"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <boost/thread.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rtunnel {
+
+log4cpp::Category& frame_replay::logger = log4cpp::Category::getInstance(std::string("rtunnel.frame_replay"));
+
+frame_replay::frame_replay(const std::string& file, bool originalTiming, int loops) :
+		file(file), originalTiming(originalTiming), loops(loops), inboundFrames(0), outboundFrames(0), inboundBytes(0), outboundBytes(0),
+		malformed(0), corruptFrames(0), closedStreams(0), elapsedUs(0) {
+	memset(protocols, 0, sizeof(protocols));
+}
+
+void frame_replay::run(boost::system::error_code& ec) {
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		::close(fd);
+		return;
+	}
+	std::size_t len = st.st_size;
+	if (len < frame_capture::FILE_HEADER_SIZE) {
+		ec = boost::asio::error::invalid_argument;
+		::close(fd);
+		return;
+	}
+	void* region = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (region == MAP_FAILED) {
+		ec = boost::system::error_code(errno, boost::system::system_category());
+		return;
+	}
+	madvise(region, len, MADV_SEQUENTIAL);
+	const unsigned char* data = (const unsigned char*) region;
+	if (schema::big_endian<boost::uint32_t>::load(data) != frame_capture::MAGIC
+			|| schema::big_endian<boost::uint32_t>::load(data + 4) != frame_capture::FORMAT_VERSION) {
+		ec = boost::asio::error::invalid_argument;
+	}
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < loops && !ec; i++) {
+		this->play(data, len, ec);
+	}
+	this->elapsedUs = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+	munmap(region, len);
+}
+
+/**
+ * one pass over the capture, the same way parseFrames() and the tunnel
+ * writer handle frames: a packet per frame, decoded and dispatched, or
+ * encoded and wrapped.
+ */
+void frame_replay::play(const unsigned char* data, std::size_t len, boost::system::error_code& ec) {
+	std::size_t offset = frame_capture::FILE_HEADER_SIZE;
+	boost::uint64_t first = 0;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	while (offset < len) {
+		const unsigned char* record = data + offset;
+		if (len - offset < frame_capture::RECORD_HEADER_SIZE + 5) {
+			frame_replay::logger.warn(str(boost::format("capture %1% ends in a partial record at %2%.") % file % offset));
+			return;
+		}
+		const unsigned char* frame = record + frame_capture::RECORD_HEADER_SIZE;
+		boost::uint32_t dataLen = schema::big_endian<boost::uint32_t>::load(frame + 1);
+		// the largest packet there is, the same limit parseFrames() applies.
+		boost::uint32_t trailer = (frame[0] & packet::CHECKSUMMED) ? 4 : 0;
+		if (dataLen >= (boost::uint32_t) packet::PACKET_MAX_SIZE + trailer) {
+			frame_replay::logger.error(str(boost::format("capture %1% has a %2% byte frame at %3%.") % file % dataLen % offset));
+			ec = boost::asio::error::invalid_argument;
+			return;
+		}
+		if (len - offset - frame_capture::RECORD_HEADER_SIZE - 5 < dataLen) {
+			frame_replay::logger.warn(str(boost::format("capture %1% ends in a partial record at %2%.") % file % offset));
+			return;
+		}
+		offset += frame_capture::RECORD_HEADER_SIZE + 5 + dataLen;
+
+		if (this->originalTiming) {
+			boost::uint64_t time = schema::big_endian<boost::uint64_t>::load(record);
+			if (first == 0) {
+				first = time;
+			}
+			if (time > first) {
+				boost::this_thread::sleep(start + boost::posix_time::microseconds(time - first));
+			}
+		}
+		// readPacket() makes room for the trailer.
+		packet p(std::min(dataLen, (boost::uint32_t) packet::PACKET_MAX_SIZE - 1));
+		p.readPacket(std::vector<unsigned char>(frame, frame + 5 + dataLen), 5 + dataLen);
+		this->protocols[p.getProtocol()]++;
+		if ((record[8] >> 7) == frame_capture::INBOUND) {
+			this->inboundFrames++;
+			this->inboundBytes += 5 + dataLen;
+			if (!p.decode()) {
+				this->corruptFrames++;
+				continue;
+			}
+			control_dispatcher<frame_replay>::dispatch(*this, p);
+		} else {
+			this->outboundFrames++;
+			// recorded sealed, sealed again the way the client does it.
+			bool sealed = p.isChecksummed();
+			if (sealed && !p.decode()) {
+				this->corruptFrames++;
+				continue;
+			}
+			p.encode();
+			if (sealed) {
+				p.appendChecksum();
+			}
+			this->outboundBytes += boost::asio::buffer_size(p.wrapPacket());
+		}
+	}
+}
+
+std::string frame_replay::toString() {
+	double seconds = this->elapsedUs > 0 ? this->elapsedUs / 1000000.0 : 1e-6;
+	unsigned long frames = this->inboundFrames + this->outboundFrames;
+	unsigned long long bytes = this->inboundBytes + this->outboundBytes;
+	std::string types;
+	for (int i = 0; i < 16; i++) {
+		if (this->protocols[i] > 0) {
+			types += str(boost::format(" 0x%1$02x=%2%") % i % this->protocols[i]);
+		}
+	}
+	unsigned long long payload = 0;
+	for (std::map<unsigned int, unsigned long long>::iterator it = this->streams.begin(); it != this->streams.end(); ++it) {
+		payload += it->second;
+	}
+	return str(boost::format("replayed %1% %2% time(s) in %3$.3fs: %4% frames (%5% in, %6% out), %7% bytes, %8$.0f frames/s, %9$.1f MB/s\n"
+			"protocols:%10%, malformed=%11%, corrupt=%15%\n"
+			"streams: %12% seen, %13% closed, %14% payload bytes")
+			% this->file % this->loops % seconds % frames % this->inboundFrames % this->outboundFrames % bytes
+			% (frames / seconds) % (bytes / seconds / 1048576) % types % this->malformed
+			% this->streams.size() % this->closedStreams % payload % this->corruptFrames);
+}
+
+void frame_replay::onControl(const heart_beat_message&, packet&) {
+}
+
+void frame_replay::onControl(const ack_heart_beat_message&, packet&) {
+}
+
+void frame_replay::onControl(const create_tcp_server_message&, packet&) {
+}
+
+void frame_replay::onControl(const ack_create_tcp_server_message&, packet&) {
+}
+
+void frame_replay::onControl(const new_tcp_socket_message& m, packet&) {
+	this->streams.insert(std::make_pair(m.stream, 0ULL));
+}
+
+void frame_replay::onControl(const ack_new_tcp_socket_message&, packet&) {
+}
+
+void frame_replay::onControl(const close_tunnel_message&, packet&) {
+}
+
+void frame_replay::onControl(const tunnel_mode_message&, packet&) {
+}
+
+void frame_replay::onControl(const ack_tunnel_mode_message&, packet&) {
+}
+
+/**
+ * the demultiplexer: DATA goes to its stream's sink, no bytes close it.
+ */
+void frame_replay::onPacket(packet& p) {
+	if (!p.isProtocol(packet::DATA)) {
+		return;
+	}
+	if (p.getDataLen() < 4) {
+		this->onMalformed(p);
+		return;
+	}
+	unsigned int stream = schema::big_endian<unsigned int>::load(p.dataAt(0));
+	if (p.getDataLen() == 4) {
+		this->closedStreams++;
+		return;
+	}
+	this->streams[stream] += p.getDataLen() - 4;
+}
+
+void frame_replay::onMalformed(packet&) {
+	this->malformed++;
+}
+
+frame_replay::~frame_replay() {
+}
+
+} /* namespace rtunnel */
@@ -0,0 +1,70 @@
+/*
+ * replay.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef REPLAY_HPP_
+#define REPLAY_HPP_
+
+#include <map>
+#include <string>
+#include <boost/asio.hpp>
+#include <log4cpp/Category.hh>
+#include "controlschema.hpp"
+#include "packet.hpp"
+
+namespace rtunnel {
+
+/**
+ * plays a frame_capture file back through the packet layer, with a sink
+ * standing in for the sockets: inbound frames are read, decoded and
+ * dispatched to per stream byte counters, outbound frames are read,
+ * encoded, sealed if they were and wrapped for writing.
+ *
+ * The capture is memory mapped and played as fast as possible, or at the
+ * pace it was recorded at, loops times over.
+ */
+class frame_replay {
+public:
+	frame_replay(const std::string& file, bool originalTiming, int loops);
+	void run(boost::system::error_code& ec);
+	std::string toString();
+	virtual ~frame_replay();
+private:
+	static log4cpp::Category& logger;
+
+	std::string file;
+	bool originalTiming;
+	int loops;
+	unsigned long inboundFrames;
+	unsigned long outboundFrames;
+	unsigned long long inboundBytes;
+	unsigned long long outboundBytes;
+	unsigned long protocols[16];
+	unsigned long malformed;
+	// frames whose checksum did not match
+	unsigned long corruptFrames;
+	// the demultiplexed payload of every stream seen
+	std::map<unsigned int, unsigned long long> streams;
+	unsigned long closedStreams;
+	long long elapsedUs;
+
+	void play(const unsigned char* data, std::size_t len, boost::system::error_code& ec);
+	void onControl(const heart_beat_message& m, packet& p);
+	void onControl(const ack_heart_beat_message& m, packet& p);
+	void onControl(const create_tcp_server_message& m, packet& p);
+	void onControl(const ack_create_tcp_server_message& m, packet& p);
+	void onControl(const new_tcp_socket_message& m, packet& p);
+	void onControl(const ack_new_tcp_socket_message& m, packet& p);
+	void onControl(const close_tunnel_message& m, packet& p);
+	void onControl(const tunnel_mode_message& m, packet& p);
+	void onControl(const ack_tunnel_mode_message& m, packet& p);
+	void onPacket(packet& p);
+	void onMalformed(packet& p);
+	template<typename Handler, typename Message> friend struct schema::dispatch_entry;
+};
+
+} /* namespace rtunnel */
+#endif /* REPLAY_HPP_ */
@@ -0,0 +1,370 @@
+/*
+ * shmring.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "shmring.hpp"
+#include <new>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/static_assert.hpp>
+
+namespace rtunnel {
+
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT32_LOCK_FREE == 2);
+BOOST_STATIC_ASSERT(sizeof(shm_ring_control) == 192);
+
+log4cpp::Category& shm_backend_stream::logger = log4cpp::Category::getInstance(std::string("rtunnel.shm_backend_stream"));
+
+const boost::uint32_t shm_backend_stream::MAGIC = 0x52545352;
+const boost::uint32_t shm_backend_stream::FORMAT_VERSION = 1;
+const boost::uint32_t shm_backend_stream::CAPACITY = 1 << 20;
+const int shm_backend_stream::MAX_READS = 64;
+const std::size_t shm_backend_stream::DATA_OFFSET = 4096;
+
+shm_ring::shm_ring() :
+		control(NULL), data(NULL), capacity(0) {
+}
+
+void shm_ring::attach(shm_ring_control* control, unsigned char* data, boost::uint32_t capacity) {
+	this->control = control;
+	this->data = data;
+	this->capacity = capacity;
+}
+
+std::size_t shm_ring::write(const unsigned char* in, std::size_t len, bool& wake) {
+	wake = false;
+	boost::uint32_t t = control->tail.load(boost::memory_order_relaxed);
+	boost::uint32_t h = control->head.load(boost::memory_order_acquire);
+	std::size_t n = std::min(len, (std::size_t) (capacity - (t - h)));
+	if (n == 0) {
+		return 0;
+	}
+	boost::uint32_t pos = t & (capacity - 1);
+	std::size_t first = std::min(n, (std::size_t) (capacity - pos));
+	memcpy(data + pos, in, first);
+	memcpy(data, in + first, n - first);
+	control->tail.store(t + (boost::uint32_t) n, boost::memory_order_seq_cst);
+	wake = control->head.load(boost::memory_order_seq_cst) == t;
+	return n;
+}
+
+std::size_t shm_ring::read(unsigned char* out, std::size_t len, bool& wake) {
+	wake = false;
+	boost::uint32_t h = control->head.load(boost::memory_order_relaxed);
+	boost::uint32_t t = control->tail.load(boost::memory_order_seq_cst);
+	std::size_t n = std::min(len, (std::size_t) (t - h));
+	if (n == 0) {
+		return 0;
+	}
+	boost::uint32_t pos = h & (capacity - 1);
+	std::size_t first = std::min(n, (std::size_t) (capacity - pos));
+	memcpy(out, data + pos, first);
+	memcpy(out + first, data, n - first);
+	control->head.store(h + (boost::uint32_t) n, boost::memory_order_seq_cst);
+	wake = control->waiting.load(boost::memory_order_seq_cst) != 0 && control->waiting.exchange(0) != 0;
+	return n;
+}
+
+bool shm_ring::waitForSpace() {
+	control->waiting.store(1, boost::memory_order_seq_cst);
+	boost::uint32_t h = control->head.load(boost::memory_order_seq_cst);
+	return control->tail.load(boost::memory_order_relaxed) - h == capacity;
+}
+
+std::size_t shm_ring::getUsed() {
+	if (control == NULL) {
+		return 0;
+	}
+	return control->tail.load(boost::memory_order_acquire) - control->head.load(boost::memory_order_acquire);
+}
+
+shm_backend_stream::shm_backend_stream(io_engine& engine) :
+		engine(engine), socketFd(-1), notifyFd(-1), peerFd(-1), region(NULL), regionSize(0), readBuffer(16384),
+		open(false), started(false), paused(false) {
+}
+
+static boost::system::error_code lastError() {
+	return boost::system::error_code(errno, boost::system::system_category());
+}
+
+void shm_backend_stream::connect(const std::string& path, boost::system::error_code& ec) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		ec = boost::asio::error::name_too_long;
+		return;
+	}
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	this->socketFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socketFd < 0 || ::connect(socketFd, (sockaddr*) &addr, sizeof(addr)) != 0) {
+		ec = lastError();
+		this->release();
+		return;
+	}
+
+#ifdef SYS_memfd_create
+	int memFd = (int) syscall(SYS_memfd_create, "rtunnel-shm", 1 /* MFD_CLOEXEC */);
+#else
+	int memFd = -1;
+	errno = ENOSYS;
+#endif
+	this->regionSize = DATA_OFFSET + 2 * (std::size_t) CAPACITY;
+	if (memFd < 0 || ftruncate(memFd, regionSize) != 0) {
+		ec = lastError();
+		if (memFd >= 0) {
+			::close(memFd);
+		}
+		this->release();
+		return;
+	}
+	this->region = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+	if (region == MAP_FAILED) {
+		ec = lastError();
+		region = NULL;
+		::close(memFd);
+		this->release();
+		return;
+	}
+	unsigned char* base = (unsigned char*) region;
+	boost::uint32_t header[3] = { MAGIC, FORMAT_VERSION, CAPACITY };
+	memcpy(base, header, sizeof(header));
+	tx.attach(new (base + 64) shm_ring_control(), base + DATA_OFFSET, CAPACITY);
+	rx.attach(new (base + 256) shm_ring_control(), base + DATA_OFFSET + CAPACITY, CAPACITY);
+
+	this->notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	this->peerFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (notifyFd < 0 || peerFd < 0) {
+		ec = lastError();
+		::close(memFd);
+		this->release();
+		return;
+	}
+
+	int fds[3] = { memFd, peerFd, notifyFd };
+	char hello = 'S';
+	iovec iov;
+	iov.iov_base = &hello;
+	iov.iov_len = 1;
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	ssize_t sent = ::sendmsg(socketFd, &msg, MSG_NOSIGNAL);
+	if (sent != 1) {
+		ec = sent < 0 ? lastError() : boost::asio::error::eof;
+	}
+	// the mapping keeps the memory, the backend has its own descriptor.
+	::close(memFd);
+	if (ec) {
+		this->release();
+	}
+}
+
+void shm_backend_stream::start(data_handler handler) {
+	this->handler = handler;
+	this->open = true;
+	this->started = true;
+	engine.watch(notifyFd, boost::bind(&shm_backend_stream::handleNotify, this, _1, _2, _3, _4));
+	engine.watch(socketFd, boost::bind(&shm_backend_stream::handleSocket, this, _1, _2, _3, _4));
+	// the backend may have written before the watch.
+	this->pump();
+}
+
+void shm_backend_stream::handleNotify(int, const unsigned char*, std::size_t, const boost::system::error_code& ec) {
+	if (ec) {
+		this->fail(ec);
+		return;
+	}
+	this->pump();
+}
+
+/**
+ * the unix socket only tells us when the backend goes away.
+ */
+void shm_backend_stream::handleSocket(int, const unsigned char*, std::size_t, const boost::system::error_code& ec) {
+	if (ec) {
+		this->fail(ec);
+	}
+}
+
+/**
+ * move queued bytes into the tx ring and hand what the backend wrote to the
+ * handler; after MAX_READS reads the other descriptors get a turn first.
+ */
+void shm_backend_stream::pump() {
+	boost::shared_ptr<backend_stream> self = shared_from_this();
+	this->flush();
+	for (int i = 0; i < MAX_READS && this->open && !this->paused; i++) {
+		bool wake;
+		std::size_t n = rx.read(&readBuffer[0], readBuffer.size(), wake);
+		if (wake) {
+			this->signal();
+		}
+		if (n == 0) {
+			return;
+		}
+		handler(&readBuffer[0], n, boost::system::error_code());
+	}
+	if (this->open && !this->paused && rx.getUsed() > 0) {
+		engine.post(boost::bind(&shm_backend_stream::pump, boost::static_pointer_cast<shm_backend_stream>(self)));
+	}
+}
+
+void shm_backend_stream::write(const unsigned char* data, std::size_t len) {
+	if (!this->open) {
+		return;
+	}
+	if (overflow.empty()) {
+		bool wake;
+		std::size_t n = tx.write(data, len, wake);
+		if (wake) {
+			this->signal();
+		}
+		data += n;
+		len -= n;
+		if (len == 0) {
+			return;
+		}
+	}
+	overflow.insert(overflow.end(), data, data + len);
+	memory_governor::instance().charge(len);
+	this->flush();
+}
+
+/**
+ * write as much of the overflow as fits; when the ring is full the backend
+ * wakes us once it has read some.
+ */
+void shm_backend_stream::flush() {
+	bool wake = false;
+	std::size_t offset = 0;
+	while (this->open && offset < overflow.size()) {
+		bool w;
+		std::size_t n = tx.write(&overflow[offset], overflow.size() - offset, w);
+		wake = wake || w;
+		offset += n;
+		if (n == 0 && tx.waitForSpace()) {
+			break;
+		}
+	}
+	offset = std::min(offset, overflow.size());
+	overflow.erase(overflow.begin(), overflow.begin() + offset);
+	memory_governor::instance().credit(offset);
+	// give back what a burst grew it to.
+	trimBuffer(overflow);
+	if (wake) {
+		this->signal();
+	}
+}
+
+void shm_backend_stream::signal() {
+	boost::uint64_t one = 1;
+	if (::write(peerFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		logger.debug(str(boost::format("signalling the backend failed: %1%") % strerror(errno)));
+	}
+}
+
+bool shm_backend_stream::isFlushed() {
+	return !this->open || (overflow.empty() && tx.getUsed() == 0);
+}
+
+void shm_backend_stream::fail(const boost::system::error_code& ec) {
+	if (!this->open) {
+		return;
+	}
+	boost::shared_ptr<backend_stream> self = shared_from_this();
+	data_handler h = handler;
+	this->close();
+	h(NULL, 0, ec);
+}
+
+/**
+ * the ring positions live in this process' mapping, shared memory streams
+ * are not handed over; client_bootstrap closes them when a handoff begins.
+ */
+int shm_backend_stream::handOver(boost::function<void()>) {
+	return -1;
+}
+
+void shm_backend_stream::close() {
+	if (!this->open) {
+		return;
+	}
+	this->open = false;
+	memory_governor::instance().credit(overflow.size());
+	std::vector<unsigned char>().swap(overflow);
+	// the engine closes what it watches.
+	engine.unwatch(notifyFd);
+	engine.unwatch(socketFd);
+	notifyFd = -1;
+	socketFd = -1;
+	this->release();
+}
+
+void shm_backend_stream::release() {
+	int* fds[3] = { &socketFd, &notifyFd, &peerFd };
+	for (int i = 0; i < 3; i++) {
+		if (*fds[i] >= 0) {
+			::close(*fds[i]);
+			*fds[i] = -1;
+		}
+	}
+	if (region != NULL) {
+		munmap(region, regionSize);
+		region = NULL;
+		tx.attach(NULL, NULL, 0);
+		rx.attach(NULL, NULL, 0);
+	}
+}
+
+/**
+ * bytes that did not fit in the tx ring.
+ */
+std::size_t shm_backend_stream::getQueuedBytes() {
+	return overflow.size();
+}
+
+void shm_backend_stream::stopReading() {
+	this->paused = true;
+}
+
+void shm_backend_stream::startReading() {
+	if (!this->paused) {
+		return;
+	}
+	this->paused = false;
+	if (this->open) {
+		engine.post(boost::bind(&shm_backend_stream::pump, boost::static_pointer_cast<shm_backend_stream>(shared_from_this())));
+	}
+}
+
+shm_backend_stream::~shm_backend_stream() {
+	this->close();
+	this->release();
+}
+
+} /* namespace rtunnel */
@@ -0,0 +1,129 @@
+/*
+ * shmring.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef SHMRING_HPP_
+#define SHMRING_HPP_
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <log4cpp/Category.hh>
+#include "backendstream.hpp"
+
+namespace rtunnel {
+
+/**
+ * control words of one ring, each on its own cache line. Both processes
+ * map them, so they must be lock-free.
+ */
+struct shm_ring_control {
+	boost::atomic<boost::uint32_t> tail;
+	char tailPad[64 - sizeof(boost::atomic<boost::uint32_t>)];
+	boost::atomic<boost::uint32_t> head;
+	char headPad[64 - sizeof(boost::atomic<boost::uint32_t>)];
+	boost::atomic<boost::uint32_t> waiting;
+	char waitingPad[64 - sizeof(boost::atomic<boost::uint32_t>)];
+};
+
+/**
+ * single producer / single consumer byte ring in shared memory. tail and
+ * head run free and wrap at 2^32; capacity is a power of two.
+ *
+ * Wake-ups: write() reports when the consumer had drained the ring before
+ * it, since the consumer sleeps only on an empty ring; read() reports when
+ * the producer asked to be woken for space through waitForSpace(). Both
+ * sides store their index before loading the other's, so one of them always
+ * sees the other's update and no wake-up is lost.
+ */
+class shm_ring {
+public:
+	shm_ring();
+
+	void attach(shm_ring_control* control, unsigned char* data, boost::uint32_t capacity);
+	std::size_t write(const unsigned char* data, std::size_t len, bool& wake);
+	std::size_t read(unsigned char* out, std::size_t len, bool& wake);
+	/**
+	 * @return false if there is space already, nothing to wait for.
+	 */
+	bool waitForSpace();
+	std::size_t getUsed();
+private:
+	shm_ring_control* control;
+	unsigned char* data;
+	boost::uint32_t capacity;
+};
+
+/**
+ * backend stream over shared memory, for a cooperating backend on this
+ * host. It avoids the loopback tcp stack: bytes are copied once into the
+ * ring and once out of it, with an eventfd write as the only syscall, and
+ * none at all while the peer is busy draining.
+ *
+ * Handshake: connect to the backend's unix socket and send one byte 'S'
+ * with three descriptors attached (SCM_RIGHTS): a memfd holding the region
+ * below, the eventfd to signal the backend, and the eventfd the backend
+ * signals. The unix socket carries nothing else; either side closing it
+ * ends the stream.
+ *
+ * Region, native byte order:
+ *   0                   magic "RTSR", version 1, capacity (3 x uint32)
+ *   64                  client -> backend ring control
+ *   256                 backend -> client ring control
+ *   4096                client -> backend data, capacity bytes
+ *   4096 + capacity     backend -> client data, capacity bytes
+ */
+class shm_backend_stream: public backend_stream {
+public:
+	static const boost::uint32_t MAGIC;
+	static const boost::uint32_t FORMAT_VERSION;
+	static const boost::uint32_t CAPACITY;
+
+	shm_backend_stream(io_engine& engine);
+
+	void connect(const std::string& path, boost::system::error_code& ec);
+	void start(data_handler handler);
+	void write(const unsigned char* data, std::size_t len);
+	bool isFlushed();
+	void close();
+	int handOver(boost::function<void()> released);
+	std::size_t getQueuedBytes();
+
+	virtual ~shm_backend_stream();
+protected:
+	void stopReading();
+	void startReading();
+private:
+	static log4cpp::Category& logger;
+	static const int MAX_READS;
+	static const std::size_t DATA_OFFSET;
+
+	io_engine& engine;
+	int socketFd;
+	int notifyFd;
+	int peerFd;
+	void* region;
+	std::size_t regionSize;
+	shm_ring tx;
+	shm_ring rx;
+	std::vector<unsigned char> overflow;
+	std::vector<unsigned char> readBuffer;
+	bool open;
+	bool started;
+	bool paused;
+	data_handler handler;
+
+	void handleNotify(int fd, const unsigned char* data, std::size_t len, const boost::system::error_code& ec);
+	void handleSocket(int fd, const unsigned char* data, std::size_t len, const boost::system::error_code& ec);
+	void pump();
+	void flush();
+	void signal();
+	void fail(const boost::system::error_code& ec);
+	void release();
+};
+
+} /* namespace rtunnel */
+#endif /* SHMRING_HPP_ */
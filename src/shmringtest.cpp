@@ -0,0 +1,255 @@
+/*
+ * shmringtest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "shmring.hpp"
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace rtunnel;
+
+/**
+ * one small ring: wrap-around of the data and of the free running
+ * indices, partial writes and reads, the wake-up flags; then a producer
+ * and a consumer thread that sleep on eventfds exactly as the handshake
+ * says, so a lost wake-up shows as a timeout.
+ */
+static const boost::uint32_t CAPACITY = 4096;
+static const unsigned long long STREAM_BYTES = 32ULL * 1024 * 1024;
+static const int WAIT_MS = 10000;
+
+static bool failed = false;
+
+static void fail(const std::string& what) {
+	std::cout << what << std::endl;
+	failed = true;
+}
+
+static unsigned char sequenceByte(unsigned long long i) {
+	return (unsigned char) (i % 251);
+}
+
+static void attach(shm_ring& ring, shm_ring_control& control, std::vector<unsigned char>& data, boost::uint32_t start) {
+	control.tail.store(start);
+	control.head.store(start);
+	control.waiting.store(0);
+	data.assign(CAPACITY, 0);
+	ring.attach(&control, &data[0], CAPACITY);
+}
+
+static void testWrapAround() {
+	shm_ring_control control;
+	std::vector<unsigned char> data;
+	shm_ring ring;
+	// the indices wrap at 2^32 halfway through.
+	attach(ring, control, data, 0xffffffffU - 5000);
+	std::vector<unsigned char> in(3000);
+	std::vector<unsigned char> out(3000);
+	unsigned long long written = 0;
+	unsigned long long read = 0;
+	bool wake;
+	for (int round = 0; round < 8; round++) {
+		for (std::size_t i = 0; i < in.size(); i++) {
+			in[i] = sequenceByte(written + i);
+		}
+		if (ring.write(&in[0], in.size(), wake) != in.size() || ring.getUsed() != in.size()) {
+			fail("a write that fits was cut short");
+			return;
+		}
+		written += in.size();
+		if (ring.read(&out[0], out.size(), wake) != out.size() || ring.getUsed() != 0) {
+			fail("a read of all there is was cut short");
+			return;
+		}
+		for (std::size_t i = 0; i < out.size(); i++) {
+			if (out[i] != sequenceByte(read + i)) {
+				std::cout << "byte " << read + i << " wrong after wrapping round" << std::endl;
+				failed = true;
+				return;
+			}
+		}
+		read += out.size();
+	}
+}
+
+static void testPartial() {
+	shm_ring_control control;
+	std::vector<unsigned char> data;
+	shm_ring ring;
+	attach(ring, control, data, 100);
+	std::vector<unsigned char> in(CAPACITY + 100, 7);
+	std::vector<unsigned char> out(CAPACITY);
+	bool wake;
+	if (ring.write(&in[0], in.size(), wake) != CAPACITY || !wake) {
+		fail("a write into an empty ring did not fill it and wake the consumer");
+	}
+	if (ring.write(&in[0], 1, wake) != 0 || wake) {
+		fail("a write into a full ring took bytes or woke the consumer");
+	}
+	if (ring.read(&out[0], 100, wake) != 100 || wake) {
+		fail("a partial read took the wrong amount or woke a producer that was not waiting");
+	}
+	if (ring.write(&in[0], 200, wake) != 100 || wake) {
+		fail("a write did not take exactly the space freed, or woke a busy consumer");
+	}
+	if (ring.read(&out[0], out.size() + 10, wake) != CAPACITY || ring.read(&out[0], 1, wake) != 0) {
+		fail("a read did not take exactly what was there");
+	}
+}
+
+/**
+ * read() reports a producer that asked through waitForSpace(), once.
+ */
+static void testWakeFlags() {
+	shm_ring_control control;
+	std::vector<unsigned char> data;
+	shm_ring ring;
+	attach(ring, control, data, 0);
+	std::vector<unsigned char> bytes(CAPACITY);
+	bool wake;
+	ring.write(&bytes[0], CAPACITY, wake);
+	if (!ring.waitForSpace()) {
+		fail("waitForSpace() on a full ring said there is space");
+	}
+	if (ring.read(&bytes[0], 1, wake) != 1 || !wake) {
+		fail("a read did not wake the producer waiting for space");
+	}
+	if (ring.read(&bytes[0], 1, wake) != 1 || wake) {
+		fail("a producer was woken twice for one wait");
+	}
+	if (ring.waitForSpace()) {
+		fail("waitForSpace() with space free said the ring is full");
+	}
+	ring.write(&bytes[0], 1, wake);
+	if (wake) {
+		fail("a write into a ring the consumer had not drained woke it");
+	}
+}
+
+static void signal(int fd) {
+	boost::uint64_t one = 1;
+	if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+		fail("eventfd write failed");
+	}
+}
+
+static bool sleepOn(int fd) {
+	pollfd p;
+	p.fd = fd;
+	p.events = POLLIN;
+	p.revents = 0;
+	if (poll(&p, 1, WAIT_MS) != 1) {
+		return false;
+	}
+	boost::uint64_t count;
+	return read(fd, &count, sizeof(count)) == sizeof(count);
+}
+
+struct handshake {
+	shm_ring ring;
+	// the consumer sleeps on this one, the producer on space
+	int dataFd;
+	int spaceFd;
+	boost::atomic<bool> stuck;
+	unsigned long producerSleeps;
+	unsigned long consumerSleeps;
+};
+
+static void produce(handshake& h) {
+	std::vector<unsigned char> chunk(3 * CAPACITY / 2);
+	unsigned long long written = 0;
+	boost::uint32_t seed = 7;
+	while (written < STREAM_BYTES && !h.stuck) {
+		seed = seed * 1103515245 + 12345;
+		std::size_t len = std::min((std::size_t) (1 + (seed >> 8) % chunk.size()), (std::size_t) (STREAM_BYTES - written));
+		for (std::size_t i = 0; i < len; i++) {
+			chunk[i] = sequenceByte(written + i);
+		}
+		std::size_t offset = 0;
+		while (offset < len && !h.stuck) {
+			bool wake;
+			std::size_t n = h.ring.write(&chunk[offset], len - offset, wake);
+			if (wake) {
+				signal(h.dataFd);
+			}
+			offset += n;
+			if (n == 0 && h.ring.waitForSpace()) {
+				h.producerSleeps++;
+				if (!sleepOn(h.spaceFd)) {
+					std::cout << "producer not woken with " << h.ring.getUsed() << " bytes in the ring" << std::endl;
+					h.stuck = true;
+				}
+			}
+		}
+		written += len;
+	}
+}
+
+static void testHandshake() {
+	shm_ring_control control;
+	std::vector<unsigned char> data;
+	handshake h;
+	attach(h.ring, control, data, 0xfffff000U);
+	h.dataFd = eventfd(0, EFD_CLOEXEC);
+	h.spaceFd = eventfd(0, EFD_CLOEXEC);
+	h.stuck = false;
+	h.producerSleeps = 0;
+	h.consumerSleeps = 0;
+	boost::thread producer(boost::bind(produce, boost::ref(h)));
+
+	std::vector<unsigned char> out(CAPACITY);
+	unsigned long long read = 0;
+	boost::uint32_t seed = 11;
+	bool corrupt = false;
+	while (read < STREAM_BYTES && !h.stuck && !corrupt) {
+		seed = seed * 1103515245 + 12345;
+		bool wake;
+		std::size_t n = h.ring.read(&out[0], 1 + (seed >> 8) % out.size(), wake);
+		if (wake) {
+			signal(h.spaceFd);
+		}
+		if (n == 0) {
+			h.consumerSleeps++;
+			if (!sleepOn(h.dataFd)) {
+				std::cout << "consumer not woken after " << read << " bytes" << std::endl;
+				h.stuck = true;
+			}
+			continue;
+		}
+		for (std::size_t i = 0; i < n; i++) {
+			if (out[i] != sequenceByte(read + i)) {
+				std::cout << "byte " << read + i << " lost, repeated or out of order" << std::endl;
+				corrupt = true;
+				break;
+			}
+		}
+		read += n;
+	}
+	if (h.stuck || corrupt) {
+		failed = true;
+		// the producer gives up on its next wait at the latest.
+		h.stuck = true;
+		signal(h.spaceFd);
+	}
+	producer.join();
+	close(h.dataFd);
+	close(h.spaceFd);
+	std::cout << read << " bytes through a " << CAPACITY << " byte ring, producer slept " << h.producerSleeps << " times, consumer "
+			<< h.consumerSleeps << std::endl;
+}
+
+int main() {
+	testWrapAround();
+	testPartial();
+	testWakeFlags();
+	testHandshake();
+	std::cout << (failed ? "shm ring test failed" : "shm ring test passed") << std::endl;
+	return failed ? 1 : 0;
+}
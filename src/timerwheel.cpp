@@ -0,0 +1,168 @@
+/*
+ * timerwheel.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "timerwheel.hpp"
+#include <time.h>
+
+namespace rtunnel {
+
+/**
+ * ticks follow the monotonic clock, so stepping the wall clock neither
+ * fires every timer at once nor stalls them.
+ */
+static unsigned long long monotonicMillis() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+wheel_timer::wheel_timer() :
+		prev(this), next(this), wheel(NULL), expires(0) {
+}
+
+wheel_timer::wheel_timer(boost::function<void()> callback) :
+		prev(this), next(this), wheel(NULL), expires(0), callback(callback) {
+}
+
+void wheel_timer::setCallback(boost::function<void()> callback) {
+	this->callback = callback;
+}
+
+bool wheel_timer::isArmed() {
+	return this->next != this;
+}
+
+void wheel_timer::cancel() {
+	if (this->isArmed()) {
+		this->unlink();
+		wheel->armed--;
+	}
+}
+
+void wheel_timer::unlink() {
+	prev->next = next;
+	next->prev = prev;
+	prev = next = this;
+}
+
+wheel_timer::~wheel_timer() {
+	this->cancel();
+}
+
+timer_wheel::timer_wheel(int tickMs) :
+		tickMs(tickMs), epoch(monotonicMillis()), currentTick(0), armed(0) {
+}
+
+/**
+ * (re)arm timer to fire delayMs from now, give or take one tick.
+ * Re-arming an armed timer moves it.
+ *
+ * @param timer
+ * @param delayMs
+ */
+void timer_wheel::arm(wheel_timer& timer, int delayMs) {
+	timer.cancel();
+	unsigned long long ticks = delayMs <= 0 ? 1 : (delayMs + tickMs - 1) / tickMs;
+	timer.wheel = this;
+	timer.expires = currentTick + ticks;
+	this->insert(timer);
+	armed++;
+}
+
+void timer_wheel::insert(wheel_timer& timer) {
+	// a timer cascading down on the tick it is due goes to the level 0 slot
+	// advance() expires right after the cascade.
+	unsigned long long delta = timer.expires > currentTick ? timer.expires - currentTick : 0;
+	if (delta == 0) {
+		timer.expires = currentTick;
+	}
+	int level = 0;
+	while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+		level++;
+	}
+	unsigned long long limit = 1ULL << (SLOT_BITS * LEVELS);
+	if (delta >= limit) {
+		timer.expires = currentTick + limit - 1;
+	}
+	wheel_timer& slot = slots[level][(timer.expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+	timer.prev = slot.prev;
+	timer.next = &slot;
+	slot.prev->next = &timer;
+	slot.prev = &timer;
+}
+
+/**
+ * run every timer due by now. Catches up tick by tick if the driver was
+ * late.
+ */
+void timer_wheel::advance() {
+	this->advance(monotonicMillis() - epoch);
+}
+
+/**
+ * run every timer due elapsedMs after the wheel was created.
+ */
+void timer_wheel::advance(unsigned long long elapsedMs) {
+	unsigned long long now = elapsedMs / tickMs;
+	while (currentTick < now) {
+		currentTick++;
+		if ((currentTick & (SLOTS - 1)) == 0) {
+			for (int level = 1; level < LEVELS; level++) {
+				this->cascade(level);
+				if (((currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)) != 0) {
+					break;
+				}
+			}
+		}
+		this->expire(slots[0][currentTick & (SLOTS - 1)]);
+	}
+}
+
+/**
+ * move the timers of the current slot of level one level (or more) down.
+ */
+void timer_wheel::cascade(int level) {
+	wheel_timer& slot = slots[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+	while (slot.next != &slot) {
+		wheel_timer* timer = slot.next;
+		timer->unlink();
+		this->insert(*timer);
+	}
+}
+
+void timer_wheel::expire(wheel_timer& slot) {
+	// callbacks may arm or cancel any timer, this one included, so take
+	// them off the slot one at a time.
+	while (slot.next != &slot) {
+		wheel_timer* timer = slot.next;
+		timer->cancel();
+		if (timer->callback) {
+			timer->callback();
+		}
+	}
+}
+
+int timer_wheel::getTickMs() {
+	return tickMs;
+}
+
+std::size_t timer_wheel::getArmed() {
+	return armed;
+}
+
+timer_wheel::~timer_wheel() {
+	// leave user-owned timers disarmed rather than pointing into us.
+	for (int level = 0; level < LEVELS; level++) {
+		for (int i = 0; i < SLOTS; i++) {
+			while (slots[level][i].next != &slots[level][i]) {
+				slots[level][i].next->unlink();
+			}
+		}
+	}
+}
+
+} /* namespace rtunnel */
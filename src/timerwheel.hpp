@@ -0,0 +1,83 @@
+/*
+ * timerwheel.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef TIMERWHEEL_HPP_
+#define TIMERWHEEL_HPP_
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace rtunnel {
+
+class timer_wheel;
+
+/**
+ * a timeout scheduled on a timer_wheel. Owned by the user, usually as a
+ * member of whatever times out; destroying an armed timer cancels it.
+ */
+class wheel_timer: private boost::noncopyable {
+public:
+	wheel_timer();
+	explicit wheel_timer(boost::function<void()> callback);
+
+	void setCallback(boost::function<void()> callback);
+	bool isArmed();
+	void cancel();
+
+	virtual ~wheel_timer();
+private:
+	friend class timer_wheel;
+	wheel_timer* prev;
+	wheel_timer* next;
+	timer_wheel* wheel;
+	unsigned long long expires;
+	boost::function<void()> callback;
+
+	void unlink();
+};
+
+/**
+ * hashed hierarchical timer wheel: 4 levels of 64 slots, so with the
+ * default 10ms tick level 0 covers 640ms, level 1 41s, level 2 44min and
+ * level 3 47h; longer timeouts are clamped. Arming and cancelling are O(1)
+ * list splices, timers are only touched again when their slot cascades
+ * down a level.
+ *
+ * Not thread-safe: one wheel per io thread, driven by a single periodic
+ * timer calling advance().
+ */
+class timer_wheel: private boost::noncopyable {
+public:
+	explicit timer_wheel(int tickMs);
+
+	void arm(wheel_timer& timer, int delayMs);
+	void advance();
+	void advance(unsigned long long elapsedMs);
+	int getTickMs();
+	std::size_t getArmed();
+
+	virtual ~timer_wheel();
+private:
+	friend class wheel_timer;
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 6;
+	static const int SLOTS = 1 << SLOT_BITS;
+
+	int tickMs;
+	// monotonic milliseconds at creation
+	unsigned long long epoch;
+	unsigned long long currentTick;
+	std::size_t armed;
+	wheel_timer slots[LEVELS][SLOTS];
+
+	void insert(wheel_timer& timer);
+	void cascade(int level);
+	void expire(wheel_timer& slot);
+};
+
+} /* namespace rtunnel */
+#endif /* TIMERWHEEL_HPP_ */
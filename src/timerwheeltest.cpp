@@ -0,0 +1,206 @@
+/*
+ * timerwheeltest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "timerwheel.hpp"
+#include <iostream>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/smart_ptr.hpp>
+
+using namespace rtunnel;
+
+/**
+ * drives timer wheels tick by tick on a made up clock: every timer must
+ * fire once, on the tick it was due, whichever levels it cascaded through.
+ */
+static const int TICK_MS = 10;
+static const unsigned long long LEVEL_1 = 64;
+static const unsigned long long LEVEL_2 = 64 * 64;
+static const unsigned long long LEVEL_3 = 64 * 64 * 64;
+// the longest timeout, what longer ones are clamped to
+static const unsigned long long HORIZON = 64 * 64 * 64 * 64 - 1;
+
+struct probe {
+	wheel_timer timer;
+	unsigned long long due;
+	std::vector<unsigned long long> fired;
+};
+
+static unsigned long long tick = 0;
+static bool failed = false;
+
+static void fail(const std::string& what) {
+	std::cout << what << std::endl;
+	failed = true;
+}
+
+static void onFire(probe* p) {
+	p->fired.push_back(tick);
+}
+
+static void runTo(timer_wheel& wheel, unsigned long long to) {
+	while (tick < to) {
+		tick++;
+		wheel.advance(tick * TICK_MS);
+	}
+}
+
+static boost::shared_ptr<probe> arm(timer_wheel& wheel, unsigned long long ticks) {
+	boost::shared_ptr<probe> p(new probe());
+	p->timer.setCallback(boost::bind(onFire, p.get()));
+	p->due = tick + ticks;
+	wheel.arm(p->timer, (int) (ticks * TICK_MS));
+	return p;
+}
+
+static void expectFired(const std::vector<boost::shared_ptr<probe> >& probes, const std::string& what) {
+	for (std::size_t i = 0; i < probes.size(); i++) {
+		probe& p = *probes[i];
+		if (p.fired.size() != 1 || p.fired[0] != p.due) {
+			std::cout << what << ": timer due at tick " << p.due << " fired " << p.fired.size() << " times";
+			if (!p.fired.empty()) {
+				std::cout << ", first at tick " << p.fired[0];
+			}
+			std::cout << std::endl;
+			failed = true;
+		}
+	}
+}
+
+/**
+ * timeouts on both sides of every level boundary, armed on a tick that
+ * starts a level 1 slot, one in the middle of it and one just before the
+ * level 2 slot changes.
+ */
+static void testCascading() {
+	const unsigned long long delays[] = { 1, 2, 63, LEVEL_1, LEVEL_1 + 1, 2 * LEVEL_1 - 1, 2 * LEVEL_1, LEVEL_2 - 1, LEVEL_2,
+			LEVEL_2 + 1, LEVEL_2 + LEVEL_1, 2 * LEVEL_2 + 7, LEVEL_3 - 1, LEVEL_3, LEVEL_3 + 1, LEVEL_3 + LEVEL_2 + LEVEL_1 + 1 };
+	const unsigned long long starts[] = { 0, 37, LEVEL_2 - 3 };
+	const std::size_t count = sizeof(delays) / sizeof(delays[0]);
+	timer_wheel wheel(TICK_MS);
+	tick = 0;
+	std::vector<boost::shared_ptr<probe> > probes;
+	unsigned long long last = 0;
+	for (std::size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+		runTo(wheel, starts[s]);
+		std::size_t pending = 0;
+		for (std::size_t i = 0; i < probes.size(); i++) {
+			pending += probes[i]->fired.empty() ? 1 : 0;
+		}
+		for (std::size_t i = 0; i < count; i++) {
+			probes.push_back(arm(wheel, delays[i]));
+			last = std::max(last, probes.back()->due);
+		}
+		if (wheel.getArmed() != pending + count) {
+			fail("armed count off after arming");
+		}
+	}
+	runTo(wheel, last + LEVEL_1);
+	expectFired(probes, "cascading");
+	if (wheel.getArmed() != 0) {
+		fail("armed count off after expiring");
+	}
+}
+
+/**
+ * timeouts past the last level fire at the horizon, also when that wraps
+ * round to the level 3 slot being cascaded.
+ */
+static void testClamping() {
+	timer_wheel wheel(TICK_MS);
+	tick = 0;
+	std::vector<boost::shared_ptr<probe> > probes;
+	probes.push_back(arm(wheel, HORIZON));
+	boost::shared_ptr<probe> clamped = arm(wheel, 1000 * 1000 * 1000 / TICK_MS);
+	clamped->due = HORIZON;
+	probes.push_back(clamped);
+	runTo(wheel, 100);
+	clamped = arm(wheel, 1000 * 1000 * 1000 / TICK_MS);
+	clamped->due = tick + HORIZON;
+	probes.push_back(clamped);
+	runTo(wheel, 100 + HORIZON + 1);
+	expectFired(probes, "clamping");
+}
+
+static void cancelOther(probe* p, wheel_timer* other, timer_wheel* wheel, int rearmTicks) {
+	onFire(p);
+	other->cancel();
+	// cancelling the timer that is firing does nothing, it is disarmed already.
+	p->timer.cancel();
+	if (rearmTicks > 0 && p->fired.size() == 1) {
+		wheel->arm(p->timer, rearmTicks * TICK_MS);
+	}
+}
+
+/**
+ * callbacks cancel timers due on the same tick and re-arm themselves.
+ */
+static void testCancelFromCallback() {
+	timer_wheel wheel(TICK_MS);
+	tick = 0;
+	probe first, second, third, late;
+	first.timer.setCallback(boost::bind(cancelOther, &first, &second.timer, &wheel, 3));
+	second.timer.setCallback(boost::bind(onFire, &second));
+	third.timer.setCallback(boost::bind(cancelOther, &third, &late.timer, &wheel, 0));
+	late.timer.setCallback(boost::bind(onFire, &late));
+	wheel.arm(first.timer, 5 * TICK_MS);
+	wheel.arm(second.timer, 5 * TICK_MS);
+	wheel.arm(third.timer, 5 * TICK_MS);
+	// on a higher level when it is cancelled
+	wheel.arm(late.timer, (int) (LEVEL_2 * TICK_MS));
+	runTo(wheel, LEVEL_2 + LEVEL_1);
+	if (first.fired.size() != 2 || first.fired[0] != 5 || first.fired[1] != 8) {
+		fail("a timer re-armed from its callback did not fire again 3 ticks later");
+	}
+	if (!second.fired.empty()) {
+		fail("a timer cancelled by a callback on its tick fired anyway");
+	}
+	if (third.fired.size() != 1 || third.fired[0] != 5) {
+		fail("a timer after a cancelled one did not fire");
+	}
+	if (!late.fired.empty()) {
+		fail("a timer cancelled before it cascaded fired anyway");
+	}
+	if (wheel.getArmed() != 0 || first.timer.isArmed() || late.timer.isArmed()) {
+		fail("timers still armed after the cancel test");
+	}
+}
+
+/**
+ * a wheel going away first leaves its timers disarmed, they can be
+ * cancelled, destroyed or armed on another wheel.
+ */
+static void testDestructor() {
+	probe near, far;
+	near.timer.setCallback(boost::bind(onFire, &near));
+	far.timer.setCallback(boost::bind(onFire, &far));
+	{
+		timer_wheel wheel(TICK_MS);
+		wheel.arm(near.timer, TICK_MS);
+		wheel.arm(far.timer, (int) (LEVEL_3 * TICK_MS));
+	}
+	if (near.timer.isArmed() || far.timer.isArmed()) {
+		fail("timers still armed after their wheel is gone");
+	}
+	near.timer.cancel();
+	timer_wheel other(TICK_MS);
+	tick = 0;
+	other.arm(near.timer, 2 * TICK_MS);
+	runTo(other, 3);
+	if (near.fired.size() != 1 || near.fired[0] != 2 || !far.fired.empty()) {
+		fail("a timer did not fire on the wheel it was armed on after its first one was gone");
+	}
+}
+
+int main() {
+	testCascading();
+	testClamping();
+	testCancelFromCallback();
+	testDestructor();
+	std::cout << (failed ? "timer wheel test failed" : "timer wheel test passed") << std::endl;
+	return failed ? 1 : 0;
+}
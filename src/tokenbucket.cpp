@@ -0,0 +1,82 @@
+/*
+ * tokenbucket.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "tokenbucket.hpp"
+#include <algorithm>
+#include <math.h>
+#include <time.h>
+
+namespace rtunnel {
+
+token_bucket::token_bucket() :
+		rate(0), burst(0), tokens(0), last(0) {
+}
+
+void token_bucket::setRate(double rate, double burst) {
+	this->rate = rate;
+	this->burst = burst;
+	this->tokens = burst;
+	this->last = now();
+}
+
+bool token_bucket::isLimited() {
+	return rate > 0;
+}
+
+void token_bucket::consume(double n, long long nowUs) {
+	if (rate <= 0) {
+		return;
+	}
+	refill(nowUs);
+	tokens -= n;
+}
+
+bool token_bucket::tryTake(double n, long long nowUs) {
+	if (rate <= 0) {
+		return true;
+	}
+	refill(nowUs);
+	if (tokens < n) {
+		return false;
+	}
+	tokens -= n;
+	return true;
+}
+
+int token_bucket::getDelayMs(long long nowUs) {
+	if (rate <= 0) {
+		return 0;
+	}
+	refill(nowUs);
+	if (tokens >= 0) {
+		return 0;
+	}
+	return std::max(1, (int) ceil(-tokens * 1000 / rate));
+}
+
+double token_bucket::getTokens(long long nowUs) {
+	refill(nowUs);
+	return tokens;
+}
+
+long long token_bucket::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void token_bucket::refill(long long nowUs) {
+	if (nowUs > last) {
+		tokens = std::min(burst, tokens + (nowUs - last) * rate / 1000000);
+		last = nowUs;
+	}
+}
+
+token_bucket::~token_bucket() {
+}
+
+} /* namespace rtunnel */
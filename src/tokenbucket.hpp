@@ -0,0 +1,55 @@
+/*
+ * tokenbucket.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef TOKENBUCKET_HPP_
+#define TOKENBUCKET_HPP_
+
+namespace rtunnel {
+
+/**
+ * a rate limit: rate tokens a second, at most burst saved up.
+ *
+ * Nothing refills the bucket in the background, it is topped up from the
+ * time elapsed whenever it is used. consume() may run it into debt, for
+ * data that is read already; getDelayMs() tells how long until the debt
+ * is paid off.
+ */
+class token_bucket {
+public:
+	token_bucket();
+	/**
+	 * @param rate tokens a second, 0 for no limit.
+	 * @param burst tokens to start with and to save up at most.
+	 */
+	void setRate(double rate, double burst);
+	bool isLimited();
+	void consume(double n, long long nowUs);
+	/**
+	 * take n tokens if there are that many.
+	 */
+	bool tryTake(double n, long long nowUs);
+	/**
+	 * @return ms until the bucket is out of debt, 0 if it is not in debt.
+	 */
+	int getDelayMs(long long nowUs);
+	double getTokens(long long nowUs);
+	/**
+	 * monotonic microseconds, what the nowUs arguments take.
+	 */
+	static long long now();
+	virtual ~token_bucket();
+private:
+	double rate;
+	double burst;
+	double tokens;
+	long long last;
+
+	void refill(long long nowUs);
+};
+
+} /* namespace rtunnel */
+#endif /* TOKENBUCKET_HPP_ */
@@ -0,0 +1,100 @@
+/*
+ * tokenbuckettest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "tokenbucket.hpp"
+#include <iostream>
+#include <string>
+#include <math.h>
+
+using namespace rtunnel;
+
+/**
+ * a bucket of 1000 tokens a second and a burst of 500, on a made up
+ * clock: it takes the burst at once, runs into debt, tells how long the
+ * debt lasts and refills to the burst and no further.
+ */
+static const double RATE = 1000;
+static const double BURST = 500;
+static const long long SECOND = 1000000;
+
+static bool failed = false;
+
+static void expect(bool ok, const std::string& what) {
+	if (!ok) {
+		std::cout << what << std::endl;
+		failed = true;
+	}
+}
+
+static bool near(double value, double expected) {
+	return fabs(value - expected) < 0.01;
+}
+
+static void testUnlimited() {
+	token_bucket bucket;
+	long long t = token_bucket::now();
+	expect(!bucket.isLimited(), "a new bucket is limited");
+	bucket.consume(1e9, t);
+	expect(bucket.tryTake(1e9, t), "an unlimited bucket refused tokens");
+	expect(bucket.getDelayMs(t) == 0, "an unlimited bucket went into debt");
+	bucket.setRate(0, BURST);
+	expect(!bucket.isLimited() && bucket.tryTake(1e9, t), "rate 0 is not unlimited");
+}
+
+static void testBurst() {
+	token_bucket bucket;
+	bucket.setRate(RATE, BURST);
+	long long t = token_bucket::now();
+	expect(bucket.isLimited(), "a bucket with a rate is not limited");
+	expect(near(bucket.getTokens(t), BURST), "a bucket does not start with its burst");
+	expect(bucket.tryTake(BURST, t), "the burst was refused");
+	expect(!bucket.tryTake(1, t), "a token taken from an empty bucket");
+	expect(near(bucket.getTokens(t), 0), "a refused take took tokens");
+	expect(bucket.tryTake(100, t + SECOND / 10), "100 tokens not refilled after 100ms");
+	expect(!bucket.tryTake(1, t + SECOND / 10), "more refilled than the time allows");
+}
+
+static void testDebt() {
+	token_bucket bucket;
+	bucket.setRate(RATE, BURST);
+	long long t = token_bucket::now();
+	bucket.consume(BURST + 1000, t);
+	expect(near(bucket.getTokens(t), -1000), "consume() did not run into debt");
+	expect(bucket.getDelayMs(t) == 1000, "1000 tokens of debt do not last a second");
+	expect(!bucket.tryTake(1, t), "a token taken while in debt");
+	expect(bucket.getDelayMs(t + SECOND / 4) == 750, "debt not paid off at the rate");
+	// an earlier time changes nothing, the clock does not go back.
+	expect(bucket.getDelayMs(t) == 750, "an earlier time refilled or drained the bucket");
+	expect(bucket.getDelayMs(t + SECOND) == 0, "still in debt after it was paid off");
+	expect(near(bucket.getTokens(t + SECOND), 0), "paid off to the wrong balance");
+
+	bucket.consume(0.1, t + SECOND);
+	expect(bucket.getDelayMs(t + SECOND) == 1, "a fraction of a token of debt is no delay");
+}
+
+static void testRefillCap() {
+	token_bucket bucket;
+	bucket.setRate(RATE, BURST);
+	long long t = token_bucket::now();
+	bucket.consume(BURST, t);
+	expect(near(bucket.getTokens(t + 60 * SECOND), BURST), "an idle bucket saved up more than its burst");
+	expect(bucket.tryTake(BURST, t + 60 * SECOND), "the saved up burst was refused");
+	expect(!bucket.tryTake(1, t + 60 * SECOND), "an idle bucket saved up more than its burst");
+	// a new rate starts over from a full burst.
+	bucket.consume(10 * BURST, t + 60 * SECOND);
+	bucket.setRate(2 * RATE, BURST);
+	expect(bucket.getDelayMs(token_bucket::now()) == 0, "setRate() kept the debt");
+}
+
+int main() {
+	testUnlimited();
+	testBurst();
+	testDebt();
+	testRefillCap();
+	std::cout << (failed ? "token bucket test failed" : "token bucket test passed") << std::endl;
+	return failed ? 1 : 0;
+}
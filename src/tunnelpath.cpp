@@ -0,0 +1,140 @@
+/*
+ * tunnelpath.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "tunnelpath.hpp"
+#include <boost/format.hpp>
+
+namespace rtunnel {
+
+log4cpp::Category& tunnel_path::logger = log4cpp::Category::getInstance(std::string("rtunnel.tunnel_path"));
+
+tunnel_path::tunnel_path(int index, const std::string& host, int port) :
+		index(index), host(host), port(port), state(DOWN), fd(-1), engine(NULL), srtt(-1), heartbeatTime(0), heartbeatSentUs(-1), downTicks(0), connects(0), accepted(0),
+		refused(0), frameChecksum(false), checksumRequired(false), corruptFrames(0), pausedFor(0) {
+}
+
+double tunnel_path::getScore() {
+	if (srtt < 0) {
+		return -1;
+	}
+	return std::max(srtt, 1.0) * (1 + this->getQueueDepth() / 64.0);
+}
+
+/**
+ * packets queued for the tunnel, or udp segments in flight.
+ */
+std::size_t tunnel_path::getQueueDepth() {
+	if (writer.get() != NULL) {
+		return writer->getDepth();
+	}
+	if (udp.get() != NULL) {
+		return udp->getInflight();
+	}
+	return 0;
+}
+
+/**
+ * the tunnel takes no more for now, backend reads should stop.
+ */
+bool tunnel_path::isCongested() {
+	if (writer.get() != NULL) {
+		return writer->isCongested();
+	}
+	return udp.get() != NULL && udp->isCongested();
+}
+
+void tunnel_path::updateRtt(long long rtt) {
+	this->srtt = srtt < 0 ? rtt : 0.8 * srtt + 0.2 * rtt;
+}
+
+bool tunnel_path::isOpen() {
+	return state == UP || state == DRAINING;
+}
+
+std::string tunnel_path::getStateName() {
+	switch (state) {
+	case CONNECTING:
+		return "connecting";
+	case UP:
+		return "up";
+	case DRAINING:
+		return "draining";
+	default:
+		return "down";
+	}
+}
+
+std::string tunnel_path::toString() {
+	return str(boost::format("path %1% %2%:%3% %4% srtt=%5%ms depth=%6% streams=%7% accepted=%8% refused=%9% checksum=%10% corrupt=%11%")
+			% index % host % port % this->getStateName() % srtt % this->getQueueDepth() % streams.size() % accepted % refused
+			% (frameChecksum ? "on" : "off") % corruptFrames);
+}
+
+/**
+ * what was read from the tunnel and not parsed yet, and what the streams
+ * it fed have not written to their backends yet.
+ */
+std::size_t tunnel_path::getBufferedBytes() {
+	std::size_t bytes = inbound.size();
+	for (std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> >::iterator it = streams.begin(); it != streams.end(); ++it) {
+		bytes += it->second->getQueuedBytes();
+	}
+	for (std::size_t i = 0; i < lingeringStreams.size(); i++) {
+		bytes += lingeringStreams[i].first->getQueuedBytes();
+	}
+	for (std::map<unsigned int, pending_stream>::iterator it = connecting.begin(); it != connecting.end(); ++it) {
+		bytes += it->second.data.size();
+	}
+	if (udp.get() != NULL) {
+		bytes += udp->getBufferedBytes();
+	}
+	return bytes;
+}
+
+void tunnel_path::pauseReads() {
+	logger.info(str(boost::format("pausing reads on path %1%, over memory budget.") % index));
+	this->pauseReads(PAUSE_GOVERNOR);
+}
+
+void tunnel_path::resumeReads() {
+	logger.info(str(boost::format("resuming reads on path %1%.") % index));
+	this->resumeReads(PAUSE_GOVERNOR);
+}
+
+void tunnel_path::pauseReads(pause_reason reason) {
+	bool reading = this->pausedFor == 0;
+	this->pausedFor |= reason;
+	if (reading && engine != NULL && fd >= 0) {
+		engine->pauseReads(fd);
+	}
+	if (reading && udp.get() != NULL) {
+		udp->pauseReceive();
+	}
+}
+
+void tunnel_path::resumeReads(pause_reason reason) {
+	if ((this->pausedFor & reason) == 0) {
+		return;
+	}
+	this->pausedFor &= ~(unsigned int) reason;
+	if (this->pausedFor == 0 && engine != NULL && fd >= 0) {
+		engine->resumeReads(fd);
+	}
+	if (this->pausedFor == 0 && udp.get() != NULL) {
+		udp->resumeReceive();
+	}
+}
+
+void tunnel_path::trimBuffers() {
+	trimBuffer(inbound);
+}
+
+tunnel_path::~tunnel_path() {
+	memory_governor::instance().credit(inbound.size());
+}
+
+} /* namespace rtunnel */
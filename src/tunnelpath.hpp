@@ -0,0 +1,124 @@
+/*
+ * tunnelpath.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef TUNNELPATH_HPP_
+#define TUNNELPATH_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+#include "backendstream.hpp"
+#include "ioengine.hpp"
+#include "memorygovernor.hpp"
+#include "timerwheel.hpp"
+#include "tunnelwriter.hpp"
+#include "udptunnel.hpp"
+
+namespace rtunnel {
+
+/**
+ * the tunnel to one transit server, and the backend streams it carries.
+ *
+ * With several transit servers every one has its path, all connected at
+ * once. A path that measures much worse than the best one is DRAINING: it
+ * refuses new streams, so the transit side places them on another server,
+ * and keeps the streams it has until they close. Stream ids are chosen by
+ * each transit server, so they are only unique within a path.
+ *
+ * The memory governor sees a path as holding what it read, what its
+ * streams still have to write to their backends and what a udp tunnel
+ * buffers, and pauses its tunnel reads to bring that down; a handoff pauses them too, reads go on once
+ * neither does.
+ *
+ * Owned and used by the io engine thread.
+ */
+class tunnel_path: public governed_stream {
+public:
+	enum path_state {
+		DOWN, CONNECTING, UP, DRAINING
+	};
+	/**
+	 * a stream accepted by the transit server whose backend connection is
+	 * still being made; what the tunnel carries for it meanwhile is held.
+	 */
+	struct pending_stream {
+		// tells this connect from an earlier one of the same stream id
+		unsigned long ticket;
+		std::vector<unsigned char> data;
+		bool closed;
+	};
+	enum pause_reason {
+		PAUSE_GOVERNOR = 1, PAUSE_HANDOFF = 2
+	};
+
+	tunnel_path(int index, const std::string& host, int port);
+
+	/**
+	 * smoothed heart beat rtt scaled by how full the send queue is, lower
+	 * is better; negative while no rtt has been measured.
+	 */
+	double getScore();
+	std::size_t getQueueDepth();
+	bool isCongested();
+	void updateRtt(long long rtt);
+	bool isOpen();
+	std::string getStateName();
+	std::string toString();
+
+	std::size_t getBufferedBytes();
+	void pauseReads();
+	void resumeReads();
+	void trimBuffers();
+	void pauseReads(pause_reason reason);
+	void resumeReads(pause_reason reason);
+
+	virtual ~tunnel_path();
+
+	int index;
+	std::string host;
+	int port;
+	path_state state;
+	int fd;
+	io_engine* engine;
+	boost::shared_ptr<rtunnel::tunnel_writer> writer;
+	boost::shared_ptr<rtunnel::udp_tunnel> udp;
+	// bytes read from the tunnel that do not make a whole frame yet
+	std::vector<unsigned char> inbound;
+	rtunnel::wheel_timer heartbeatTimer;
+	rtunnel::wheel_timer idleTimer;
+	double srtt;
+	// the time the last heart beat carried, and when it left on the
+	// monotonic clock; its ack is timed against that, not the echo
+	unsigned long long heartbeatTime;
+	long long heartbeatSentUs;
+	int downTicks;
+	// reconnects in the background while the other paths carry traffic
+	boost::shared_ptr<boost::thread> connectThread;
+	std::map<unsigned int, boost::shared_ptr<rtunnel::backend_stream> > streams;
+	// closed by the transit server, waiting for their writes to drain
+	std::vector<std::pair<boost::shared_ptr<rtunnel::backend_stream>, int> > lingeringStreams;
+	// backend connections being made off the engine thread
+	std::map<unsigned int, pending_stream> connecting;
+	unsigned long connects;
+	unsigned long accepted;
+	unsigned long refused;
+	// the transit server takes checksummed frames, ours are sealed
+	bool frameChecksum;
+	// the transit server seals its frames too, an unsealed one is corrupt
+	bool checksumRequired;
+	// frames received whose checksum did not match, or that had none
+	unsigned long corruptFrames;
+	// pause_reason bits, tunnel reads are paused while any is set
+	unsigned int pausedFor;
+private:
+	static log4cpp::Category& logger;
+};
+
+} /* namespace rtunnel */
+#endif /* TUNNELPATH_HPP_ */
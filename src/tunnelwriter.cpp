@@ -0,0 +1,190 @@
+/*
+ * tunnelwriter.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "tunnelwriter.hpp"
+#include <boost/bind.hpp>
+
+namespace rtunnel {
+
+const std::size_t tunnel_writer::MAX_BATCH = 256;
+const std::size_t tunnel_writer::MAX_QUEUED_BYTES = 1024 * 1024;
+
+tunnel_writer::tunnel_writer(io_engine& engine, int fd, std::size_t capacity) :
+		engine(engine), fd(fd), queue(capacity), freePackets(capacity), rejected(0), drainScheduled(false), waitingForSocket(false), congested(false), batches(0) {
+	this->highWatermark = queue.getCapacity() * 3 / 4;
+	this->lowWatermark = queue.getCapacity() / 4;
+	this->dataLimit = queue.getCapacity() * 7 / 8;
+	engine.setWriteHandler(fd, boost::bind(&tunnel_writer::handleWritten, this, _1, _2));
+}
+
+/**
+ * a cleared packet from the pool, or a new one if the pool is empty.
+ *
+ * @param size
+ */
+packet* tunnel_writer::obtain(int size) {
+	packet* p;
+	if (freePackets.pop(p)) {
+		p->ensureSize(size);
+		return p;
+	}
+	return new packet(size);
+}
+
+/**
+ * queue a packet for the tunnel, may be called from any thread.
+ *
+ * @param p
+ * @return false if the queue is 7/8 full; the caller still owns p.
+ */
+bool tunnel_writer::offer(packet* p) {
+	return this->push(p, dataLimit);
+}
+
+/**
+ * like offer(), but the reserve above 7/8 may be used too.
+ */
+bool tunnel_writer::offerControl(packet* p) {
+	return this->push(p, queue.getCapacity());
+}
+
+bool tunnel_writer::push(packet* p, std::size_t limit) {
+	if (queue.getDepth() >= limit || !queue.tryPush(p)) {
+		this->rejected.fetch_add(1, boost::memory_order_relaxed);
+		this->congested.store(true, boost::memory_order_relaxed);
+		this->scheduleDrain();
+		return false;
+	}
+	if (queue.getDepth() >= highWatermark) {
+		this->congested.store(true, boost::memory_order_relaxed);
+	}
+	this->scheduleDrain();
+	return true;
+}
+
+void tunnel_writer::recycle(packet* p) {
+	p->clear();
+	// a burst may have grown it, do not park the extra on the free list.
+	p->trim();
+	if (!freePackets.bounded_push(p)) {
+		delete p;
+	}
+}
+
+void tunnel_writer::setResumeHandler(boost::function<void()> handler) {
+	this->resumeHandler = handler;
+}
+
+bool tunnel_writer::isCongested() {
+	return this->congested.load(boost::memory_order_relaxed);
+}
+
+/**
+ * stop writing to fd, which the caller is about to give up; packets still
+ * queued are dropped. Engine thread only.
+ */
+void tunnel_writer::close() {
+	if (this->fd >= 0) {
+		engine.setWriteHandler(this->fd, io_engine::write_handler());
+	}
+	this->fd = -1;
+	if (this->waitingForSocket) {
+		// no write completes for us any more, a last drain drops the rest.
+		this->waitingForSocket = false;
+		engine.post(boost::bind(&tunnel_writer::drain, this));
+	}
+}
+
+/**
+ * @return true once no drain is pending, i.e. the writer may be destroyed
+ *         if nobody offers any more packets.
+ */
+bool tunnel_writer::isIdle() {
+	return !drainScheduled.load(boost::memory_order_acquire);
+}
+
+std::size_t tunnel_writer::getDepth() {
+	return queue.getDepth();
+}
+
+unsigned long tunnel_writer::getWritten() {
+	return queue.getPopped();
+}
+
+unsigned long tunnel_writer::getRejected() {
+	return rejected.load(boost::memory_order_relaxed);
+}
+
+unsigned long tunnel_writer::getBatches() {
+	return batches.load(boost::memory_order_relaxed);
+}
+
+/**
+ * at most one drain is posted to the engine at a time, however many
+ * producers there are.
+ */
+void tunnel_writer::scheduleDrain() {
+	if (!drainScheduled.exchange(true, boost::memory_order_acq_rel)) {
+		engine.post(boost::bind(&tunnel_writer::drain, this));
+	}
+}
+
+void tunnel_writer::drain() {
+	packet* p;
+	for (std::size_t n = 0; n < MAX_BATCH && !this->isSocketFull() && queue.tryPop(p); n++) {
+		if (fd >= 0) {
+			boost::asio::const_buffer frame = p->wrapPacket();
+			engine.write(fd, boost::asio::buffer_cast<const unsigned char*>(frame), boost::asio::buffer_size(frame));
+		}
+		this->recycle(p);
+	}
+	batches.fetch_add(1, boost::memory_order_relaxed);
+	if (queue.getDepth() > 0 && this->isSocketFull()) {
+		// still scheduled as far as the producers are concerned, they need
+		// not post drains that would stop right here.
+		this->waitingForSocket = true;
+		return;
+	}
+	drainScheduled.store(false, boost::memory_order_release);
+	// a producer may have pushed after the last pop but seen the flag set.
+	if (queue.getDepth() > 0) {
+		this->scheduleDrain();
+	}
+	if (congested.load(boost::memory_order_relaxed) && queue.getDepth() <= lowWatermark) {
+		congested.store(false, boost::memory_order_relaxed);
+		if (resumeHandler) {
+			resumeHandler();
+		}
+	}
+}
+
+bool tunnel_writer::isSocketFull() {
+	return fd >= 0 && engine.getQueuedBytes(fd) >= MAX_QUEUED_BYTES;
+}
+
+/**
+ * a write to the tunnel socket completed, go on with a drain stopped at
+ * MAX_QUEUED_BYTES once half of it is gone.
+ */
+void tunnel_writer::handleWritten(int, std::size_t queued) {
+	if (this->waitingForSocket && queued < MAX_QUEUED_BYTES / 2) {
+		this->waitingForSocket = false;
+		this->drain();
+	}
+}
+
+tunnel_writer::~tunnel_writer() {
+	packet* p;
+	while (queue.tryPop(p)) {
+		delete p;
+	}
+	while (freePackets.pop(p)) {
+		delete p;
+	}
+}
+
+} /* namespace rtunnel */
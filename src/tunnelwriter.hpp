@@ -0,0 +1,87 @@
+/*
+ * tunnelwriter.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef TUNNELWRITER_HPP_
+#define TUNNELWRITER_HPP_
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/lockfree/stack.hpp>
+#include "ioengine.hpp"
+#include "mpscqueue.hpp"
+#include "packet.hpp"
+
+namespace rtunnel {
+
+/**
+ * the single writer of the tunnel socket.
+ *
+ * Any number of producer threads offer() packets; they are queued on a
+ * lock-free mpsc queue and written by the io engine thread in batches.
+ * Packets are pooled: obtain() one, fill it, offer() it, and the writer
+ * recycles it once written.
+ *
+ * Backpressure: offer() fails once the queue is 7/8 full, and
+ * isCongested() turns true above 3/4 of the capacity. Producers should
+ * stop reading until the resume handler is called, which happens on the
+ * engine thread once the queue has drained below 1/4. The last 1/8 is left
+ * to offerControl(), so acks and heart beats go out however busy the
+ * streams are.
+ *
+ * The queue is only drained while the engine holds less than
+ * MAX_QUEUED_BYTES for the socket; past that the packets stay queued, so
+ * a slow tunnel pushes back on the producers, and draining goes on once
+ * the kernel has taken half of it.
+ */
+class tunnel_writer {
+public:
+	tunnel_writer(io_engine& engine, int fd, std::size_t capacity);
+
+	packet* obtain(int size);
+	bool offer(packet* p);
+	bool offerControl(packet* p);
+	void recycle(packet* p);
+	void setResumeHandler(boost::function<void()> handler);
+	bool isCongested();
+	void close();
+	bool isIdle();
+
+	std::size_t getDepth();
+	unsigned long getWritten();
+	unsigned long getRejected();
+	unsigned long getBatches();
+
+	virtual ~tunnel_writer();
+private:
+	static const std::size_t MAX_BATCH;
+	static const std::size_t MAX_QUEUED_BYTES;
+
+	io_engine& engine;
+	int fd;
+	mpsc_queue<packet*> queue;
+	boost::lockfree::stack<packet*> freePackets;
+	std::size_t highWatermark;
+	std::size_t lowWatermark;
+	// offer() stops here, the rest is for offerControl()
+	std::size_t dataLimit;
+	boost::atomic<unsigned long> rejected;
+	boost::atomic<bool> drainScheduled;
+	// a drain stopped at MAX_QUEUED_BYTES, the write handler goes on
+	bool waitingForSocket;
+	boost::atomic<bool> congested;
+	boost::atomic<unsigned long> batches;
+	boost::function<void()> resumeHandler;
+
+	bool push(packet* p, std::size_t limit);
+	void scheduleDrain();
+	void drain();
+	void handleWritten(int fd, std::size_t queued);
+	bool isSocketFull();
+};
+
+} /* namespace rtunnel */
+#endif /* TUNNELWRITER_HPP_ */
@@ -0,0 +1,670 @@
+/*
+ * udptunnel.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "udptunnel.hpp"
+#include "memorygovernor.hpp"
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <time.h>
+
+namespace rtunnel {
+
+log4cpp::Category& udp_tunnel::logger = log4cpp::Category::getInstance(std::string("rtunnel.udp_tunnel"));
+
+const int udp_tunnel::SEG_HEAD_SIZE;
+const int udp_tunnel::SEG_MSS;
+const int udp_tunnel::RECEIVE_WINDOW;
+
+const int udp_tunnel::MIN_RTO = 200;
+const int udp_tunnel::MAX_RTO = 60000;
+const int udp_tunnel::MAX_TRANSMITS = 15;
+const std::size_t udp_tunnel::MAX_QUEUED_BYTES = 1024 * 1024;
+
+static void putInt(unsigned char* p, unsigned int v) {
+	p[0] = (unsigned char) (v >> 24);
+	p[1] = (unsigned char) (v >> 16);
+	p[2] = (unsigned char) (v >> 8);
+	p[3] = (unsigned char) v;
+}
+
+static unsigned int getInt(const unsigned char* p) {
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) | ((unsigned int) p[2] << 8) | (unsigned int) p[3];
+}
+
+/**
+ * rtt samples and timeouts must not jump with the wall clock.
+ */
+static unsigned long long monotonicMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+udp_tunnel::udp_tunnel(boost::asio::io_service& io_service, unsigned int conv) :
+		io_service(io_service), socket(io_service), rtoTimer(io_service), pacingTimer(io_service),
+		epoch(monotonicMicros()), conv(conv), open(false), sndUna(0), sndNxt(0), recoveryPoint(0), inRecovery(false),
+		cwnd(4), ssthresh(RECEIVE_WINDOW), peerWindow(RECEIVE_WINDOW), srtt(0), rttvar(0), rto(1000), pendingOffset(0),
+		nextSendAt(0), pacingArmed(false), rtoArmed(false), retransmits(0), queuedBytes(0), congested(false), rcvNxt(0), echoTs(0),
+		receivePaused(false), accountedBytes(0),
+		lossRate(0), delayMs(0), rng(conv) {
+}
+
+void udp_tunnel::bind(const udp::endpoint& local, boost::system::error_code& ec) {
+	if (!this->socket.is_open()) {
+		this->socket.open(local.protocol(), ec);
+		if (ec) {
+			return;
+		}
+	}
+	this->socket.bind(local, ec);
+}
+
+udp::endpoint udp_tunnel::getLocalEndpoint(boost::system::error_code& ec) {
+	return this->socket.local_endpoint(ec);
+}
+
+void udp_tunnel::connect(const std::string& host, int port, boost::system::error_code& ec) {
+	udp::resolver resolver(io_service);
+	udp::resolver::query query(host, boost::lexical_cast<std::string>(port));
+	udp::resolver::iterator endpoint_iterator = resolver.resolve(query, ec);
+	if (ec) {
+		return;
+	}
+	this->connect(endpoint_iterator->endpoint(), ec);
+}
+
+void udp_tunnel::connect(const udp::endpoint& remote, boost::system::error_code& ec) {
+	if (!this->socket.is_open()) {
+		this->socket.open(remote.protocol(), ec);
+		if (ec) {
+			return;
+		}
+	}
+	this->socket.connect(remote, ec);
+	if (ec) {
+		return;
+	}
+	this->open = true;
+	udp_tunnel::logger.info(str(boost::format("udp tunnel %1% connected to %2%:%3%.") % conv % remote.address().to_string() % remote.port()));
+	this->startReceive();
+}
+
+/**
+ * queue a packet frame for reliable delivery, may be called from any thread.
+ *
+ * @param p
+ */
+void udp_tunnel::send(packet& p) {
+	boost::asio::const_buffer frame = p.wrapPacket();
+	const unsigned char* data = boost::asio::buffer_cast<const unsigned char*>(frame);
+	boost::shared_ptr<std::vector<unsigned char> > bytes(new std::vector<unsigned char>(data, data + boost::asio::buffer_size(frame)));
+	if (queuedBytes.fetch_add(bytes->size(), boost::memory_order_relaxed) + bytes->size() >= MAX_QUEUED_BYTES) {
+		this->congested.store(true, boost::memory_order_relaxed);
+	}
+	this->io_service.post(boost::bind(&udp_tunnel::doSend, shared_from_this(), bytes));
+}
+
+void udp_tunnel::close() {
+	this->io_service.post(boost::bind(&udp_tunnel::doClose, shared_from_this()));
+}
+
+void udp_tunnel::setReceiveHandler(receive_handler handler) {
+	this->receiveHandler = handler;
+}
+
+void udp_tunnel::setCloseHandler(close_handler handler) {
+	this->closeHandler = handler;
+}
+
+void udp_tunnel::setResumeHandler(boost::function<void()> handler) {
+	this->resumeHandler = handler;
+}
+
+bool udp_tunnel::isCongested() {
+	return this->congested.load(boost::memory_order_relaxed);
+}
+
+/**
+ * keep receiving and acking, but hold the frames; the window advertised
+ * shrinks by what is held, so the peer stops before much piles up.
+ */
+void udp_tunnel::pauseReceive() {
+	this->receivePaused = true;
+}
+
+void udp_tunnel::resumeReceive() {
+	if (!this->receivePaused) {
+		return;
+	}
+	this->receivePaused = false;
+	this->deliverFrames();
+	if (this->open) {
+		// the window opens again.
+		this->sendAck();
+	}
+	this->account();
+}
+
+/**
+ * drop outgoing datagrams with probability lossRate and hold the rest for
+ * delayMs before sending, so the link can be exercised on loopback.
+ *
+ * @param lossRate
+ * @param delayMs
+ */
+void udp_tunnel::setLossInjection(double lossRate, int delayMs) {
+	this->lossRate = lossRate;
+	this->delayMs = delayMs;
+}
+
+double udp_tunnel::getCongestionWindow() {
+	return this->cwnd;
+}
+
+int udp_tunnel::getSmoothedRtt() {
+	return this->srtt;
+}
+
+int udp_tunnel::getInflight() {
+	return (int) this->inflight.size();
+}
+
+unsigned long udp_tunnel::getRetransmits() {
+	return this->retransmits;
+}
+
+/**
+ * what account() last charged to the memory governor.
+ */
+std::size_t udp_tunnel::getBufferedBytes() {
+	return this->accountedBytes;
+}
+
+unsigned long long udp_tunnel::nowMicros() {
+	return monotonicMicros() - epoch;
+}
+
+/**
+ * milliseconds since this tunnel was created, never 0 so that 0 can mean
+ * "no timestamp" on the wire.
+ */
+unsigned int udp_tunnel::now() {
+	return (unsigned int) (this->nowMicros() / 1000) + 1;
+}
+
+void udp_tunnel::startReceive() {
+	this->socket.async_receive(boost::asio::buffer(recvBuffer, sizeof(recvBuffer)),
+			boost::bind(&udp_tunnel::handleReceive, shared_from_this(), boost::asio::placeholders::error,
+					boost::asio::placeholders::bytes_transferred));
+}
+
+void udp_tunnel::handleReceive(const boost::system::error_code& ec, std::size_t len) {
+	if (!this->open) {
+		return;
+	}
+	if (ec == boost::asio::error::operation_aborted) {
+		return;
+	}
+	if (!ec) {
+		this->handleSegment(recvBuffer, len);
+		this->account();
+	} else {
+		// icmp errors on a connected udp socket are reported here, the
+		// retransmission limit decides when the peer is really gone.
+		udp_tunnel::logger.debug(str(boost::format("udp tunnel %1% receive error: %2%") % conv % ec.message()));
+	}
+	if (this->open) {
+		this->startReceive();
+	}
+}
+
+/**
+ * segment layout (big endian):
+ * kind(1) conv(4) seq(4) ack(4) sack(4) ts(4) tsEcho(4) wnd(2) len(2) payload
+ */
+void udp_tunnel::handleSegment(const unsigned char* seg, std::size_t len) {
+	if (len < (std::size_t) SEG_HEAD_SIZE) {
+		return;
+	}
+	int kind = seg[0];
+	if (getInt(seg + 1) != this->conv) {
+		return;
+	}
+	unsigned int seq = getInt(seg + 5);
+	unsigned int ack = getInt(seg + 9);
+	unsigned int sack = getInt(seg + 13);
+	unsigned int ts = getInt(seg + 17);
+	unsigned int tsEcho = getInt(seg + 21);
+	int wnd = (seg[25] << 8) | seg[26];
+	int plen = (seg[27] << 8) | seg[28];
+	if (plen > SEG_MSS || (std::size_t) (SEG_HEAD_SIZE + plen) > len) {
+		return;
+	}
+	this->peerWindow = std::max(wnd, 1);
+	// only pure acks are sent immediately, so only they give a clean rtt sample.
+	this->handleAck(ack, sack, kind == SEG_ACK ? tsEcho : 0);
+	if (!this->open) {
+		return;
+	}
+	if (kind == SEG_DATA) {
+		this->echoTs = ts;
+		this->handleData(seq, seg + SEG_HEAD_SIZE, plen);
+	} else if (kind == SEG_FIN) {
+		udp_tunnel::logger.info(str(boost::format("udp tunnel %1% closed by peer.") % conv));
+		this->fail(boost::asio::error::eof);
+	}
+}
+
+void udp_tunnel::handleAck(unsigned int ack, unsigned int sack, unsigned int tsEcho) {
+	int newlyAcked = 0;
+	if ((int) (ack - sndUna) > 0 && (int) (ack - sndNxt) <= 0) {
+		newlyAcked = (int) (ack - sndUna);
+		for (int i = 0; i < newlyAcked; i++) {
+			this->inflight.pop_front();
+		}
+		this->sndUna = ack;
+	}
+	for (int i = 0; i < 32 && sack != 0; i++) {
+		if ((sack & (1u << i)) == 0) {
+			continue;
+		}
+		unsigned int idx = ack + 1 + i - sndUna;
+		if (idx < inflight.size() && !inflight[idx].sacked) {
+			inflight[idx].sacked = true;
+			inflight[idx].lost = false;
+			newlyAcked++;
+		}
+	}
+	if (newlyAcked == 0) {
+		return;
+	}
+	if (tsEcho != 0) {
+		this->updateRtt((int) (this->now() - tsEcho));
+	}
+
+	// a segment with 3 sacked segments above it is lost; only first
+	// transmissions are judged this way, retransmissions are left to the rto.
+	int sackedAbove = 0;
+	bool lossDetected = false;
+	for (int i = (int) inflight.size() - 1; i >= 0; i--) {
+		sent_segment& seg = inflight[i];
+		if (seg.sacked) {
+			sackedAbove++;
+		} else if (sackedAbove >= 3 && seg.transmits == 1 && !seg.lost) {
+			seg.lost = true;
+			lossDetected = true;
+		}
+	}
+
+	if (this->inRecovery && (int) (sndUna - recoveryPoint) >= 0) {
+		this->inRecovery = false;
+	}
+	if (lossDetected && !this->inRecovery) {
+		this->onLoss();
+	} else if (!this->inRecovery) {
+		if (cwnd < ssthresh) {
+			cwnd += newlyAcked;
+		} else {
+			cwnd += newlyAcked / cwnd;
+		}
+		cwnd = std::min(cwnd, (double) RECEIVE_WINDOW);
+	}
+
+	if (inflight.empty()) {
+		this->rtoArmed = false;
+		this->rtoTimer.cancel();
+	} else {
+		this->rtoArmed = false;
+		this->armRto();
+	}
+	this->trySend();
+}
+
+/**
+ * multiplicative decrease, once per window of data. backs off by 0.7 rather
+ * than 0.5, random loss on long links is rarely congestion.
+ */
+void udp_tunnel::onLoss() {
+	this->ssthresh = std::max(cwnd * 0.7, 2.0);
+	this->cwnd = ssthresh;
+	this->inRecovery = true;
+	this->recoveryPoint = sndNxt;
+	udp_tunnel::logger.debug(str(boost::format("udp tunnel %1% loss, cwnd=%2%") % conv % cwnd));
+}
+
+void udp_tunnel::updateRtt(int sample) {
+	if (sample < 0) {
+		return;
+	}
+	if (srtt == 0) {
+		srtt = sample;
+		rttvar = sample / 2;
+	} else {
+		rttvar = (3 * rttvar + std::abs(srtt - sample)) / 4;
+		srtt = (7 * srtt + sample) / 8;
+	}
+	rto = std::min(std::max(srtt + 4 * rttvar, MIN_RTO), MAX_RTO);
+}
+
+void udp_tunnel::handleData(unsigned int seq, const unsigned char* data, int len) {
+	int diff = (int) (seq - rcvNxt);
+	if (diff == 0 && this->getReceiveWindow() == 0) {
+		// paused and full, the peer sends it again.
+	} else if (diff == 0) {
+		inboundBytes.insert(inboundBytes.end(), data, data + len);
+		rcvNxt++;
+		std::map<unsigned int, std::vector<unsigned char> >::iterator it;
+		while ((it = outOfOrder.find(rcvNxt)) != outOfOrder.end()) {
+			inboundBytes.insert(inboundBytes.end(), it->second.begin(), it->second.end());
+			outOfOrder.erase(it);
+			rcvNxt++;
+		}
+		this->deliverFrames();
+	} else if (diff > 0 && diff < RECEIVE_WINDOW) {
+		if (outOfOrder.find(seq) == outOfOrder.end()) {
+			outOfOrder[seq] = std::vector<unsigned char>(data, data + len);
+		}
+	}
+	// duplicates are acked too, the previous ack may have been lost.
+	if (this->open) {
+		this->sendAck();
+	}
+}
+
+/**
+ * cut complete packet frames out of the in-order byte stream.
+ */
+void udp_tunnel::deliverFrames() {
+	std::size_t offset = 0;
+	while (this->open && !this->receivePaused && inboundBytes.size() - offset >= 5) {
+		unsigned int len = getInt(&inboundBytes[offset + 1]);
+		unsigned int trailer = (inboundBytes[offset] & packet::CHECKSUMMED) ? 4 : 0;
+		if (len >= (unsigned int) packet::PACKET_MAX_SIZE + trailer) {
+			udp_tunnel::logger.error(str(boost::format("udp tunnel %1% got a %2% byte frame.") % conv % len));
+			this->fail(boost::asio::error::invalid_argument);
+			return;
+		}
+		if (inboundBytes.size() - offset < 5 + (std::size_t) len) {
+			break;
+		}
+		packet p(std::min(len, (unsigned int) packet::PACKET_MAX_SIZE - 1));
+		p.readPacket(std::vector<unsigned char>(inboundBytes.begin() + offset, inboundBytes.begin() + offset + 5 + len), 5 + len);
+		offset += 5 + len;
+		if (receiveHandler) {
+			receiveHandler(p);
+		}
+	}
+	inboundBytes.erase(inboundBytes.begin(), inboundBytes.begin() + offset);
+	trimBuffer(inboundBytes);
+}
+
+/**
+ * segments the peer may still send: the window less what is out of order,
+ * and less what is held while receiving is paused.
+ */
+int udp_tunnel::getReceiveWindow() {
+	int held = this->receivePaused ? (int) (inboundBytes.size() / SEG_MSS) : 0;
+	return std::max(RECEIVE_WINDOW - (int) outOfOrder.size() - held, 0);
+}
+
+void udp_tunnel::doSend(boost::shared_ptr<std::vector<unsigned char> > frame) {
+	if (!this->open) {
+		queuedBytes.fetch_sub(frame->size(), boost::memory_order_relaxed);
+		return;
+	}
+	pendingBytes.insert(pendingBytes.end(), frame->begin(), frame->end());
+	this->trySend();
+}
+
+/**
+ * send lost segments first, then new data, as far as the congestion window,
+ * the peer's receive window and the pacing rate allow.
+ */
+void udp_tunnel::trySend() {
+	while (this->open) {
+		int flight = 0;
+		sent_segment* lost = NULL;
+		unsigned int lostSeq = 0;
+		for (std::size_t i = 0; i < inflight.size(); i++) {
+			if (inflight[i].lost) {
+				if (lost == NULL) {
+					lost = &inflight[i];
+					lostSeq = sndUna + i;
+				}
+			} else if (!inflight[i].sacked) {
+				flight++;
+			}
+		}
+		bool hasNew = pendingOffset < pendingBytes.size() && (int) inflight.size() < std::min(peerWindow, RECEIVE_WINDOW);
+		if ((lost == NULL && !hasNew) || flight >= (int) cwnd) {
+			break;
+		}
+
+		unsigned long long t = this->nowMicros();
+		if (t < nextSendAt) {
+			this->armPacing(nextSendAt);
+			break;
+		}
+		// pace at 1.25 * cwnd / srtt, allowing up to 2 segments of catch-up.
+		unsigned long long interval = srtt == 0 ? 0 : (unsigned long long) (srtt * 1000 / (cwnd * 1.25));
+		nextSendAt = std::max(nextSendAt, t > 2 * interval ? t - 2 * interval : 0) + interval;
+
+		if (lost != NULL) {
+			lost->lost = false;
+			this->transmit(lostSeq, *lost);
+		} else {
+			std::size_t len = std::min((std::size_t) SEG_MSS, pendingBytes.size() - pendingOffset);
+			sent_segment seg;
+			seg.payload.assign(pendingBytes.begin() + pendingOffset, pendingBytes.begin() + pendingOffset + len);
+			seg.sentAt = 0;
+			seg.sacked = false;
+			seg.lost = false;
+			seg.transmits = 0;
+			pendingOffset += len;
+			queuedBytes.fetch_sub(len, boost::memory_order_relaxed);
+			inflight.push_back(seg);
+			this->transmit(sndNxt++, inflight.back());
+		}
+	}
+	if (pendingOffset > 0 && pendingOffset * 2 >= pendingBytes.size()) {
+		pendingBytes.erase(pendingBytes.begin(), pendingBytes.begin() + pendingOffset);
+		pendingOffset = 0;
+		trimBuffer(pendingBytes);
+	}
+	this->account();
+	if (congested.load(boost::memory_order_relaxed) && queuedBytes.load(boost::memory_order_relaxed) <= MAX_QUEUED_BYTES / 4) {
+		congested.store(false, boost::memory_order_relaxed);
+		if (resumeHandler) {
+			resumeHandler();
+		}
+	}
+}
+
+void udp_tunnel::transmit(unsigned int seq, sent_segment& seg) {
+	if (seg.transmits >= MAX_TRANSMITS) {
+		udp_tunnel::logger.info(str(boost::format("udp tunnel %1% segment %2% not acked after %3% transmits.") % conv % seq % seg.transmits));
+		this->fail(boost::asio::error::timed_out);
+		return;
+	}
+	if (seg.transmits > 0) {
+		this->retransmits++;
+	}
+	seg.transmits++;
+	seg.sentAt = this->now();
+	this->sendDatagram(SEG_DATA, seq, seg.payload.empty() ? NULL : &seg.payload[0], (int) seg.payload.size());
+	this->armRto();
+}
+
+void udp_tunnel::sendAck() {
+	this->sendDatagram(SEG_ACK, sndNxt, NULL, 0);
+}
+
+void udp_tunnel::sendDatagram(int kind, unsigned int seq, const unsigned char* data, int len) {
+	this->writeDatagram(this->makeDatagram(kind, seq, data, len));
+}
+
+boost::shared_ptr<std::vector<unsigned char> > udp_tunnel::makeDatagram(int kind, unsigned int seq, const unsigned char* data, int len) {
+	boost::shared_ptr<std::vector<unsigned char> > datagram(new std::vector<unsigned char>(SEG_HEAD_SIZE + len));
+	unsigned char* p = &(*datagram)[0];
+	unsigned int sack = 0;
+	for (int i = 0; i < 32 && !outOfOrder.empty(); i++) {
+		if (outOfOrder.find(rcvNxt + 1 + i) != outOfOrder.end()) {
+			sack |= 1u << i;
+		}
+	}
+	int wnd = this->getReceiveWindow();
+	p[0] = (unsigned char) kind;
+	putInt(p + 1, conv);
+	putInt(p + 5, seq);
+	putInt(p + 9, rcvNxt);
+	putInt(p + 13, sack);
+	putInt(p + 17, this->now());
+	putInt(p + 21, echoTs);
+	p[25] = (unsigned char) (wnd >> 8);
+	p[26] = (unsigned char) wnd;
+	p[27] = (unsigned char) (len >> 8);
+	p[28] = (unsigned char) len;
+	if (len > 0) {
+		std::copy(data, data + len, p + SEG_HEAD_SIZE);
+	}
+	return datagram;
+}
+
+void udp_tunnel::writeDatagram(boost::shared_ptr<std::vector<unsigned char> > datagram) {
+	if (lossRate > 0 && boost::random::uniform_real_distribution<double>(0, 1)(rng) < lossRate) {
+		return;
+	}
+	if (delayMs > 0) {
+		boost::shared_ptr<boost::asio::deadline_timer> timer(new boost::asio::deadline_timer(io_service));
+		timer->expires_from_now(boost::posix_time::milliseconds(delayMs));
+		timer->async_wait(boost::bind(&udp_tunnel::handleDelayed, shared_from_this(), timer, datagram, boost::asio::placeholders::error));
+		return;
+	}
+	this->socket.async_send(boost::asio::buffer(*datagram),
+			boost::bind(&udp_tunnel::handleWrite, shared_from_this(), datagram, boost::asio::placeholders::error));
+}
+
+/**
+ * the timer, and the datagram in handleWrite(), are only bound to keep
+ * them alive until the operation completes.
+ */
+void udp_tunnel::handleDelayed(boost::shared_ptr<boost::asio::deadline_timer>, boost::shared_ptr<std::vector<unsigned char> > datagram, const boost::system::error_code& ec) {
+	if (ec || !this->open) {
+		return;
+	}
+	this->socket.async_send(boost::asio::buffer(*datagram),
+			boost::bind(&udp_tunnel::handleWrite, shared_from_this(), datagram, boost::asio::placeholders::error));
+}
+
+void udp_tunnel::handleWrite(boost::shared_ptr<std::vector<unsigned char> >, const boost::system::error_code& ec) {
+	if (ec && ec != boost::asio::error::operation_aborted) {
+		udp_tunnel::logger.debug(str(boost::format("udp tunnel %1% send error: %2%") % conv % ec.message()));
+	}
+}
+
+void udp_tunnel::armRto() {
+	if (this->rtoArmed || !this->open) {
+		return;
+	}
+	this->rtoArmed = true;
+	this->rtoTimer.expires_from_now(boost::posix_time::milliseconds(rto));
+	this->rtoTimer.async_wait(boost::bind(&udp_tunnel::handleRto, shared_from_this(), boost::asio::placeholders::error));
+}
+
+/**
+ * retransmission timeout: everything not sacked is presumed lost and the
+ * window collapses to one segment.
+ */
+void udp_tunnel::handleRto(const boost::system::error_code& ec) {
+	if (ec == boost::asio::error::operation_aborted || !this->open) {
+		return;
+	}
+	this->rtoArmed = false;
+	if (inflight.empty()) {
+		return;
+	}
+	for (std::size_t i = 0; i < inflight.size(); i++) {
+		if (!inflight[i].sacked) {
+			inflight[i].lost = true;
+		}
+	}
+	this->ssthresh = std::max(cwnd / 2, 2.0);
+	this->cwnd = 1;
+	this->inRecovery = true;
+	this->recoveryPoint = sndNxt;
+	this->rto = std::min(rto * 2, MAX_RTO);
+	this->nextSendAt = 0;
+	this->trySend();
+	this->armRto();
+}
+
+void udp_tunnel::armPacing(unsigned long long at) {
+	if (this->pacingArmed) {
+		return;
+	}
+	this->pacingArmed = true;
+	this->pacingTimer.expires_from_now(boost::posix_time::microseconds(at - this->nowMicros()));
+	this->pacingTimer.async_wait(boost::bind(&udp_tunnel::handlePacing, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void udp_tunnel::handlePacing(const boost::system::error_code& ec) {
+	this->pacingArmed = false;
+	if (ec == boost::asio::error::operation_aborted || !this->open) {
+		return;
+	}
+	this->trySend();
+}
+
+void udp_tunnel::doClose() {
+	if (!this->open) {
+		return;
+	}
+	// best effort, the peer also notices through its own retransmission limit.
+	boost::system::error_code ignored;
+	this->socket.send(boost::asio::buffer(*this->makeDatagram(SEG_FIN, sndNxt, NULL, 0)), 0, ignored);
+	this->fail(boost::asio::error::operation_aborted);
+}
+
+/**
+ * bring the governor up to date with what the tunnel buffers: unsent bytes,
+ * unacked and out of order segments (counted as full ones) and received
+ * bytes not yet cut into frames.
+ */
+void udp_tunnel::account() {
+	std::size_t bytes = pendingBytes.size() - pendingOffset + inboundBytes.size()
+			+ (inflight.size() + outOfOrder.size()) * SEG_MSS;
+	if (bytes > accountedBytes) {
+		memory_governor::instance().charge(bytes - accountedBytes);
+	} else {
+		memory_governor::instance().credit(accountedBytes - bytes);
+	}
+	accountedBytes = bytes;
+}
+
+void udp_tunnel::fail(const boost::system::error_code& ec) {
+	if (!this->open) {
+		return;
+	}
+	this->open = false;
+	boost::system::error_code ignored;
+	this->rtoTimer.cancel(ignored);
+	this->pacingTimer.cancel(ignored);
+	this->socket.close(ignored);
+	udp_tunnel::logger.info(str(boost::format("udp tunnel %1% closed: %2%, retransmits=%3%") % conv % ec.message() % retransmits));
+	if (closeHandler) {
+		closeHandler(ec);
+	}
+}
+
+udp_tunnel::~udp_tunnel() {
+	memory_governor::instance().credit(accountedBytes);
+	boost::system::error_code ignored;
+	this->socket.close(ignored);
+}
+
+} /* namespace rtunnel */
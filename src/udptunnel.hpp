@@ -0,0 +1,174 @@
+/*
+ * udptunnel.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef UDPTUNNEL_HPP_
+#define UDPTUNNEL_HPP_
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/random.hpp>
+#include <boost/smart_ptr.hpp>
+#include <log4cpp/Category.hh>
+#include "packet.hpp"
+
+using boost::asio::ip::udp;
+
+namespace rtunnel {
+
+/**
+ * Reliable tunnel link over UDP.
+ *
+ * Carries the same packet frames as the tcp tunnel, but does its own
+ * reliability (cumulative + selective ack), pacing and congestion control,
+ * so tunneled tcp streams do not run tcp inside tcp.
+ *
+ * All state is owned by the io_service thread; send() may be called from
+ * any thread.
+ *
+ * Backpressure: isCongested() turns true once MAX_QUEUED_BYTES are sent
+ * and not cut into segments yet, producers should stop until the resume
+ * handler is called below 1/4 of it. pauseReceive() holds received frames
+ * and closes the advertised window as they pile up.
+ */
+class udp_tunnel: public boost::enable_shared_from_this<udp_tunnel> {
+public:
+	typedef boost::function<void(packet&)> receive_handler;
+	typedef boost::function<void(const boost::system::error_code&)> close_handler;
+
+	const static int SEG_DATA = 0x01;
+	const static int SEG_ACK = 0x02;
+	const static int SEG_FIN = 0x03;
+
+	const static int SEG_HEAD_SIZE = 29;
+	const static int SEG_MSS = 1200;
+	const static int RECEIVE_WINDOW = 256;
+
+	udp_tunnel(boost::asio::io_service& io_service, unsigned int conv);
+
+	void bind(const udp::endpoint& local, boost::system::error_code& ec);
+	udp::endpoint getLocalEndpoint(boost::system::error_code& ec);
+	void connect(const std::string& host, int port, boost::system::error_code& ec);
+	void connect(const udp::endpoint& remote, boost::system::error_code& ec);
+	void send(packet& p);
+	void close();
+	bool isCongested();
+	void pauseReceive();
+	void resumeReceive();
+
+	void setReceiveHandler(receive_handler handler);
+	void setCloseHandler(close_handler handler);
+	void setResumeHandler(boost::function<void()> handler);
+	void setLossInjection(double lossRate, int delayMs);
+
+	double getCongestionWindow();
+	int getSmoothedRtt();
+	int getInflight();
+	unsigned long getRetransmits();
+	std::size_t getBufferedBytes();
+
+	virtual ~udp_tunnel();
+private:
+	struct sent_segment {
+		std::vector<unsigned char> payload;
+		unsigned int sentAt;
+		bool sacked;
+		bool lost;
+		int transmits;
+	};
+
+	static log4cpp::Category& logger;
+	static const int MIN_RTO;
+	static const int MAX_RTO;
+	static const int MAX_TRANSMITS;
+	static const std::size_t MAX_QUEUED_BYTES;
+
+	boost::asio::io_service& io_service;
+	udp::socket socket;
+	boost::asio::deadline_timer rtoTimer;
+	boost::asio::deadline_timer pacingTimer;
+	// monotonic microseconds at creation
+	unsigned long long epoch;
+	unsigned int conv;
+	bool open;
+	receive_handler receiveHandler;
+	close_handler closeHandler;
+
+	// sender
+	std::vector<unsigned char> pendingBytes;
+	std::deque<sent_segment> inflight;
+	unsigned int sndUna;
+	unsigned int sndNxt;
+	unsigned int recoveryPoint;
+	bool inRecovery;
+	double cwnd;
+	double ssthresh;
+	int peerWindow;
+	int srtt;
+	int rttvar;
+	int rto;
+	std::size_t pendingOffset;
+	unsigned long long nextSendAt;
+	bool pacingArmed;
+	bool rtoArmed;
+	unsigned long retransmits;
+	// posted by send() and not cut into segments yet
+	boost::atomic<std::size_t> queuedBytes;
+	boost::atomic<bool> congested;
+	boost::function<void()> resumeHandler;
+
+	// receiver
+	unsigned int rcvNxt;
+	unsigned int echoTs;
+	std::map<unsigned int, std::vector<unsigned char> > outOfOrder;
+	std::vector<unsigned char> inboundBytes;
+	// frames are held in inboundBytes, not delivered
+	bool receivePaused;
+	// charged to the memory governor
+	std::size_t accountedBytes;
+	unsigned char recvBuffer[SEG_HEAD_SIZE + SEG_MSS + 64];
+	udp::endpoint recvFrom;
+
+	// loss / delay injection, for loopback testing
+	double lossRate;
+	int delayMs;
+	boost::random::mt19937 rng;
+
+	unsigned int now();
+	unsigned long long nowMicros();
+	void startReceive();
+	void handleReceive(const boost::system::error_code& ec, std::size_t len);
+	void handleSegment(const unsigned char* seg, std::size_t len);
+	void handleAck(unsigned int ack, unsigned int sack, unsigned int tsEcho);
+	void handleData(unsigned int seq, const unsigned char* data, int len);
+	void deliverFrames();
+	int getReceiveWindow();
+	void doSend(boost::shared_ptr<std::vector<unsigned char> > frame);
+	void trySend();
+	void transmit(unsigned int seq, sent_segment& seg);
+	void sendAck();
+	void sendDatagram(int kind, unsigned int seq, const unsigned char* data, int len);
+	boost::shared_ptr<std::vector<unsigned char> > makeDatagram(int kind, unsigned int seq, const unsigned char* data, int len);
+	void writeDatagram(boost::shared_ptr<std::vector<unsigned char> > datagram);
+	void handleWrite(boost::shared_ptr<std::vector<unsigned char> > datagram, const boost::system::error_code& ec);
+	void handleDelayed(boost::shared_ptr<boost::asio::deadline_timer> timer, boost::shared_ptr<std::vector<unsigned char> > datagram, const boost::system::error_code& ec);
+	void armRto();
+	void handleRto(const boost::system::error_code& ec);
+	void armPacing(unsigned long long at);
+	void handlePacing(const boost::system::error_code& ec);
+	void onLoss();
+	void updateRtt(int sample);
+	void account();
+	void doClose();
+	void fail(const boost::system::error_code& ec);
+};
+
+} /* namespace rtunnel */
+#endif /* UDPTUNNEL_HPP_ */
@@ -0,0 +1,108 @@
+/*
+ * udptunneltest.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "udptunnel.hpp"
+#include <iostream>
+#include <boost/bind.hpp>
+
+using namespace rtunnel;
+
+/**
+ * two udp tunnels on loopback, both dropping 5% of what they send and
+ * holding the rest for a few ms; every frame sent one way must come out
+ * of the other, complete and in order.
+ */
+static const int FRAMES = 2000;
+static const double LOSS_RATE = 0.05;
+static const int DELAY_MS = 5;
+static const int TIMEOUT_SECONDS = 60;
+
+static int received = 0;
+static bool failed = false;
+
+static void fill(std::vector<unsigned char>& bytes, int frame) {
+	// from a few bytes to several segments
+	bytes.resize(4 + (frame * 397) % 5000);
+	bytes[0] = (unsigned char) (frame >> 24);
+	bytes[1] = (unsigned char) (frame >> 16);
+	bytes[2] = (unsigned char) (frame >> 8);
+	bytes[3] = (unsigned char) frame;
+	for (std::size_t i = 4; i < bytes.size(); i++) {
+		bytes[i] = (unsigned char) (frame + i);
+	}
+}
+
+static void onReceive(boost::asio::io_service& io_service, packet& p) {
+	std::vector<unsigned char> expected;
+	fill(expected, received);
+	if (!p.isProtocol(packet::DATA) || (std::size_t) p.getDataLen() != expected.size()
+			|| !std::equal(expected.begin(), expected.end(), p.dataAt(0))) {
+		std::cout << "frame " << received << " is wrong or out of order" << std::endl;
+		failed = true;
+		io_service.stop();
+		return;
+	}
+	if (++received == FRAMES) {
+		io_service.stop();
+	}
+}
+
+static void onTimeout(boost::asio::io_service& io_service, const boost::system::error_code& ec) {
+	if (!ec) {
+		std::cout << "timed out after " << received << " frames" << std::endl;
+		failed = true;
+		io_service.stop();
+	}
+}
+
+int main() {
+	boost::asio::io_service io_service;
+	boost::shared_ptr<udp_tunnel> a(new udp_tunnel(io_service, 7));
+	boost::shared_ptr<udp_tunnel> b(new udp_tunnel(io_service, 7));
+	udp::endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+	boost::system::error_code ec;
+	a->bind(loopback, ec);
+	if (!ec) {
+		b->bind(loopback, ec);
+	}
+	udp::endpoint localA, localB;
+	if (!ec) {
+		localA = a->getLocalEndpoint(ec);
+	}
+	if (!ec) {
+		localB = b->getLocalEndpoint(ec);
+	}
+	if (!ec) {
+		a->connect(localB, ec);
+	}
+	if (!ec) {
+		b->connect(localA, ec);
+	}
+	if (ec) {
+		std::cout << "can not set up the tunnels: " << ec.message() << std::endl;
+		return 1;
+	}
+	a->setLossInjection(LOSS_RATE, DELAY_MS);
+	b->setLossInjection(LOSS_RATE, DELAY_MS);
+	b->setReceiveHandler(boost::bind(onReceive, boost::ref(io_service), _1));
+
+	for (int i = 0; i < FRAMES; i++) {
+		std::vector<unsigned char> bytes;
+		fill(bytes, i);
+		packet p(bytes.size());
+		p.setProtocol(packet::DATA);
+		p.feedBytes(bytes);
+		a->send(p);
+	}
+	boost::asio::deadline_timer timeout(io_service, boost::posix_time::seconds(TIMEOUT_SECONDS));
+	timeout.async_wait(boost::bind(onTimeout, boost::ref(io_service), boost::asio::placeholders::error));
+	io_service.run();
+
+	std::cout << received << " of " << FRAMES << " frames, " << a->getRetransmits() << " retransmits, srtt "
+			<< a->getSmoothedRtt() << "ms" << std::endl;
+	return failed || received != FRAMES ? 1 : 0;
+}
@@ -0,0 +1,708 @@
+/*
+ * uringioengine.cpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#include "uringioengine.hpp"
+
+#ifdef RTUNNEL_HAVE_IO_URING
+#include "memorygovernor.hpp"
+#include <boost/format.hpp>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifndef IORING_RECV_MULTISHOT
+#define IORING_RECV_MULTISHOT (1U << 1)
+#endif
+#endif
+
+namespace rtunnel {
+
+#ifdef RTUNNEL_HAVE_IO_URING
+
+log4cpp::Category& uring_io_engine::logger = log4cpp::Category::getInstance(std::string("rtunnel.uring_io_engine"));
+
+const unsigned int uring_io_engine::RING_ENTRIES = 1024;
+const int uring_io_engine::BUFFER_GROUP = 1;
+const int uring_io_engine::MAX_CHAIN = 64;
+
+// user_data: operation(8) | fd(24) | chain position(32)
+static const unsigned long long OP_RECV = 1;
+static const unsigned long long OP_WRITE = 2;
+static const unsigned long long OP_PROVIDE = 3;
+static const unsigned long long OP_WAKE = 4;
+static const unsigned long long OP_CANCEL = 5;
+static const unsigned long long OP_TICK = 6;
+
+static unsigned long long userData(unsigned long long op, int fd, int position) {
+	return (op << 56) | ((unsigned long long) (fd & 0xffffff) << 32) | (unsigned int) position;
+}
+
+uring_io_engine::uring_io_engine(packet_pool& pool) :
+		ringFd(-1), wakeFd(-1), wakeValue(0), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+		sqes((io_uring_sqe*) MAP_FAILED), sqesSize(0), sqHead(NULL), sqTail(NULL), sqMask(NULL), sqArray(NULL),
+		cqHead(NULL), cqTail(NULL), cqMask(NULL), cqes(NULL), sqLocalTail(0), toSubmit(0), sqEntries(0),
+		multishot(true), fixedBuffers(false), tickArmed(false), pool(pool), stopRequested(false) {
+	memset(&tickSpec, 0, sizeof(tickSpec));
+}
+
+boost::shared_ptr<io_engine> uring_io_engine::create(packet_pool& pool) {
+	boost::shared_ptr<uring_io_engine> engine(new uring_io_engine(pool));
+	if (!engine->setup()) {
+		return boost::shared_ptr<io_engine>();
+	}
+	return engine;
+}
+
+bool uring_io_engine::setup() {
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	this->ringFd = (int) syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+	if (this->ringFd < 0) {
+		logger.info(str(boost::format("io_uring_setup failed: %1%") % strerror(errno)));
+		return false;
+	}
+	this->sqEntries = params.sq_entries;
+	this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		this->sqRingSize = this->cqRingSize = std::max(sqRingSize, cqRingSize);
+	}
+	this->sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (this->sqRing == MAP_FAILED) {
+		return false;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		this->cqRing = this->sqRing;
+	} else {
+		this->cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (this->cqRing == MAP_FAILED) {
+			return false;
+		}
+	}
+	this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	this->sqes = (io_uring_sqe*) mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (this->sqes == MAP_FAILED) {
+		return false;
+	}
+	char* sq = (char*) sqRing;
+	char* cq = (char*) cqRing;
+	this->sqHead = (unsigned int*) (sq + params.sq_off.head);
+	this->sqTail = (unsigned int*) (sq + params.sq_off.tail);
+	this->sqMask = (unsigned int*) (sq + params.sq_off.ring_mask);
+	this->sqArray = (unsigned int*) (sq + params.sq_off.array);
+	this->cqHead = (unsigned int*) (cq + params.cq_off.head);
+	this->cqTail = (unsigned int*) (cq + params.cq_off.tail);
+	this->cqMask = (unsigned int*) (cq + params.cq_off.ring_mask);
+	this->cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+	this->sqLocalTail = *sqTail;
+
+	// writes use the registered pool with WRITE_FIXED; without it (e.g. a low
+	// RLIMIT_MEMLOCK) plain WRITE still works.
+	std::vector<iovec> iovs(pool.getCount());
+	for (int i = 0; i < pool.getCount(); i++) {
+		iovs[i].iov_base = pool.at(i);
+		iovs[i].iov_len = pool.getBufferSize();
+	}
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iovs[0], (unsigned int) iovs.size()) == 0) {
+		this->fixedBuffers = true;
+	} else {
+		logger.warn(str(boost::format("registering packet buffers failed: %1%, using unregistered writes.") % strerror(errno)));
+	}
+
+	this->wakeFd = eventfd(0, EFD_CLOEXEC);
+	if (this->wakeFd < 0) {
+		return false;
+	}
+	this->armWakeup();
+
+	// half of the pool receives, the other half carries writes.
+	for (int i = pool.getCount() / 2; i > 0; i--) {
+		int index = pool.acquire();
+		if (index < 0) {
+			break;
+		}
+		this->recvBuffers.push_back(index);
+		this->provideBuffer(index);
+	}
+	if (this->submit(0) < 0) {
+		return false;
+	}
+	logger.info(str(boost::format("io_uring engine ready, %1% entries, %2% receive buffers, fixed buffers %3%.")
+			% sqEntries % recvBuffers.size() % (fixedBuffers ? "on" : "off")));
+	return true;
+}
+
+void uring_io_engine::watch(int fd, read_handler handler) {
+	descriptor_ptr d(new descriptor());
+	d->fd = fd;
+	d->handler = handler;
+	d->chainLength = 0;
+	d->chainReaped = 0;
+	d->chainError = 0;
+	d->queued = false;
+	d->recvArmed = false;
+	d->paused = false;
+	d->queuedBytes = 0;
+	// pipes and eventfds are read with READ, which has no multishot form.
+	struct stat st;
+	d->stream = fstat(fd, &st) != 0 || S_ISSOCK(st.st_mode);
+	d->closing = false;
+	d->keepOpen = false;
+	this->descriptors[fd] = d;
+	this->armRecv(d);
+	this->armTicker();
+}
+
+void uring_io_engine::unwatch(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || it->second->closing) {
+		return;
+	}
+	descriptor_ptr d = it->second;
+	d->closing = true;
+	this->cancelRecv(d);
+	this->closeIfIdle(d);
+}
+
+/**
+ * like unwatch(), but receives completing before the cancel are still
+ * delivered, and the descriptor is left open.
+ */
+void uring_io_engine::release(int fd, boost::function<void()> released) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || it->second->closing) {
+		return;
+	}
+	descriptor_ptr d = it->second;
+	d->closing = true;
+	d->keepOpen = true;
+	d->released = released;
+	this->cancelRecv(d);
+	this->closeIfIdle(d);
+}
+
+/**
+ * a multishot receive keeps going until cancelled; completions already
+ * queued are still delivered.
+ */
+void uring_io_engine::pauseReads(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || it->second->closing || it->second->paused) {
+		return;
+	}
+	it->second->paused = true;
+	this->cancelRecv(it->second);
+}
+
+void uring_io_engine::resumeReads(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || it->second->closing || !it->second->paused) {
+		return;
+	}
+	it->second->paused = false;
+	// still armed if the cancel has not completed yet; handleRecv re-arms
+	// when it does.
+	if (!it->second->recvArmed) {
+		this->armRecv(it->second);
+	}
+}
+
+void uring_io_engine::write(int fd, const unsigned char* data, std::size_t len) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end() || it->second->closing) {
+		return;
+	}
+	descriptor_ptr d = it->second;
+	d->queuedBytes += len;
+	memory_governor::instance().charge(len);
+	std::size_t bufferSize = pool.getBufferSize();
+	while (len > 0) {
+		chunk c;
+		c.offset = 0;
+		c.len = std::min(len, bufferSize);
+		c.index = pool.acquire();
+		if (c.index >= 0) {
+			std::copy(data, data + c.len, pool.at(c.index));
+		} else {
+			c.heap = boost::shared_ptr<std::vector<unsigned char> >(new std::vector<unsigned char>(data, data + c.len));
+		}
+		d->pending.push_back(c);
+		data += c.len;
+		len -= c.len;
+	}
+	if (!d->queued) {
+		d->queued = true;
+		this->dirty.push_back(d);
+	}
+}
+
+std::size_t uring_io_engine::getQueuedBytes(int fd) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	return it == descriptors.end() ? 0 : it->second->queuedBytes;
+}
+
+void uring_io_engine::setWriteHandler(int fd, write_handler handler) {
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it != descriptors.end() && !it->second->closing) {
+		it->second->writeHandler = handler;
+	}
+}
+
+/**
+ * queue a handler for the run() thread and wake it, may be called from any
+ * thread.
+ */
+void uring_io_engine::post(boost::function<void()> handler) {
+	{
+		boost::mutex::scoped_lock lock(postMutex);
+		this->posted.push_back(handler);
+	}
+	this->wakeup();
+}
+
+void uring_io_engine::setTicker(int intervalMs, boost::function<void()> handler) {
+	this->tickSpec.tv_sec = intervalMs / 1000;
+	this->tickSpec.tv_nsec = (long long) (intervalMs % 1000) * 1000000;
+	this->tickHandler = handler;
+	if (!descriptors.empty()) {
+		this->armTicker();
+	}
+}
+
+/**
+ * the ticker is a plain IORING_OP_TIMEOUT, re-armed on every expiry while
+ * descriptors are watched.
+ */
+void uring_io_engine::armTicker() {
+	if (tickArmed || !tickHandler) {
+		return;
+	}
+	io_uring_sqe* sqe = this->nextSqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (unsigned long long) &tickSpec;
+	sqe->len = 1;
+	sqe->user_data = userData(OP_TICK, 0, 0);
+	tickArmed = true;
+}
+
+/**
+ * one loop pass: queue the chains for descriptors written to since the last
+ * pass, submit everything and wait in the same io_uring_enter, then run the
+ * completions.
+ */
+void uring_io_engine::run() {
+	while (true) {
+		std::vector<boost::function<void()> > handlers;
+		{
+			boost::mutex::scoped_lock lock(postMutex);
+			handlers.swap(this->posted);
+		}
+		for (std::size_t i = 0; i < handlers.size(); i++) {
+			handlers[i]();
+		}
+		if (this->stopRequested.exchange(false)) {
+			std::vector<int> fds;
+			for (std::map<int, descriptor_ptr>::iterator it = descriptors.begin(); it != descriptors.end(); ++it) {
+				fds.push_back(it->first);
+			}
+			for (std::size_t i = 0; i < fds.size(); i++) {
+				this->unwatch(fds[i]);
+			}
+		}
+		std::vector<descriptor_ptr> batch;
+		batch.swap(this->dirty);
+		for (std::size_t i = 0; i < batch.size(); i++) {
+			batch[i]->queued = false;
+			this->flushWrites(batch[i]);
+		}
+		if (descriptors.empty()) {
+			break;
+		}
+		if (this->submit(1) < 0) {
+			break;
+		}
+		this->reap();
+	}
+	// hand over whatever was queued last, e.g. buffers given back on the way out.
+	this->submit(0);
+}
+
+void uring_io_engine::stop() {
+	this->stopRequested = true;
+	this->wakeup();
+}
+
+void uring_io_engine::wakeup() {
+	unsigned long long one = 1;
+	if (::write(wakeFd, &one, sizeof(one)) < 0) {
+		logger.warn(str(boost::format("can not wake io_uring engine: %1%") % strerror(errno)));
+	}
+}
+
+std::string uring_io_engine::getName() {
+	return "uring";
+}
+
+io_uring_sqe* uring_io_engine::nextSqe() {
+	unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	if (sqLocalTail - head >= sqEntries) {
+		// ring full, let the kernel consume what is there.
+		this->submit(0);
+		head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+	unsigned int index = sqLocalTail & *sqMask;
+	io_uring_sqe* sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqArray[index] = index;
+	sqLocalTail++;
+	toSubmit++;
+	return sqe;
+}
+
+int uring_io_engine::submit(unsigned int waitFor) {
+	__atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+	while (true) {
+		int ret = (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (ret >= 0) {
+			toSubmit -= std::min((unsigned int) ret, toSubmit);
+			return ret;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno == EBUSY || errno == EAGAIN) {
+			// completion queue is full, drain it and go round again.
+			this->reap();
+			continue;
+		}
+		logger.error(str(boost::format("io_uring_enter failed: %1%") % strerror(errno)));
+		return -1;
+	}
+}
+
+void uring_io_engine::reap() {
+	unsigned int head = *cqHead;
+	while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+		io_uring_cqe cqe = cqes[head & *cqMask];
+		head++;
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		this->complete(cqe);
+	}
+}
+
+void uring_io_engine::complete(const io_uring_cqe& cqe) {
+	unsigned long long op = cqe.user_data >> 56;
+	int fd = (int) ((cqe.user_data >> 32) & 0xffffff);
+	int position = (int) (cqe.user_data & 0xffffffff);
+	if (op == OP_WAKE) {
+		this->armWakeup();
+		return;
+	}
+	if (op == OP_PROVIDE) {
+		if (cqe.res < 0) {
+			logger.error(str(boost::format("providing receive buffer failed: %1%") % strerror(-cqe.res)));
+		}
+		return;
+	}
+	if (op == OP_CANCEL) {
+		return;
+	}
+	if (op == OP_TICK) {
+		this->tickArmed = false;
+		if (!descriptors.empty()) {
+			this->tickHandler();
+			this->armTicker();
+		}
+		return;
+	}
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(fd);
+	if (it == descriptors.end()) {
+		if (cqe.flags & IORING_CQE_F_BUFFER) {
+			this->provideBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+		}
+		return;
+	}
+	if (op == OP_RECV) {
+		this->handleRecv(it->second, cqe);
+	} else if (op == OP_WRITE) {
+		this->handleWrite(it->second, position, cqe.res);
+	}
+}
+
+void uring_io_engine::armRecv(descriptor_ptr d) {
+	io_uring_sqe* sqe = this->nextSqe();
+	sqe->opcode = d->stream ? IORING_OP_RECV : IORING_OP_READ;
+	sqe->fd = d->fd;
+	sqe->len = d->stream ? 0 : pool.getBufferSize();
+	// off aliases addr2, which RECV wants zero; READ takes -1 as "current".
+	sqe->off = d->stream ? 0 : (unsigned long long) -1;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUFFER_GROUP;
+	sqe->ioprio = multishot && d->stream ? IORING_RECV_MULTISHOT : 0;
+	sqe->user_data = userData(OP_RECV, d->fd, 0);
+	d->recvArmed = true;
+}
+
+void uring_io_engine::cancelRecv(descriptor_ptr d) {
+	if (!d->recvArmed) {
+		return;
+	}
+	io_uring_sqe* sqe = this->nextSqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = userData(OP_RECV, d->fd, 0);
+	sqe->user_data = userData(OP_CANCEL, d->fd, 0);
+}
+
+void uring_io_engine::provideBuffer(int index) {
+	io_uring_sqe* sqe = this->nextSqe();
+	sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe->fd = 1;
+	sqe->addr = (unsigned long long) pool.at(index);
+	sqe->len = pool.getBufferSize();
+	sqe->off = index;
+	sqe->buf_group = BUFFER_GROUP;
+	sqe->user_data = userData(OP_PROVIDE, 0, index);
+}
+
+void uring_io_engine::armWakeup() {
+	io_uring_sqe* sqe = this->nextSqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = wakeFd;
+	sqe->addr = (unsigned long long) &wakeValue;
+	sqe->len = sizeof(wakeValue);
+	sqe->user_data = userData(OP_WAKE, 0, 0);
+}
+
+/**
+ * submit the head of the write queue as one linked chain. a short write
+ * breaks the chain (the rest complete with ECANCELED); whatever is left is
+ * sent again once the whole chain has been reaped.
+ */
+void uring_io_engine::flushWrites(descriptor_ptr d) {
+	if (d->closing || d->chainLength > 0 || d->pending.empty()) {
+		return;
+	}
+	int n = (int) std::min(d->pending.size(), (std::size_t) MAX_CHAIN);
+	for (int i = 0; i < n; i++) {
+		chunk& c = d->pending[i];
+		io_uring_sqe* sqe = this->nextSqe();
+		sqe->fd = d->fd;
+		sqe->len = (unsigned int) (c.len - c.offset);
+		if (c.index >= 0) {
+			sqe->addr = (unsigned long long) (pool.at(c.index) + c.offset);
+			if (fixedBuffers) {
+				sqe->opcode = IORING_OP_WRITE_FIXED;
+				sqe->buf_index = c.index;
+			} else {
+				sqe->opcode = IORING_OP_WRITE;
+			}
+		} else {
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->addr = (unsigned long long) (&(*c.heap)[0] + c.offset);
+		}
+		if (i < n - 1) {
+			sqe->flags = IOSQE_IO_LINK;
+		}
+		sqe->user_data = userData(OP_WRITE, d->fd, i);
+	}
+	d->chainLength = n;
+	d->chainReaped = 0;
+	d->chainError = 0;
+}
+
+void uring_io_engine::handleRecv(descriptor_ptr d, const io_uring_cqe& cqe) {
+	if (!(cqe.flags & IORING_CQE_F_MORE)) {
+		d->recvArmed = false;
+	}
+	int index = (cqe.flags & IORING_CQE_F_BUFFER) ? (int) (cqe.flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	if (d->closing && !d->keepOpen) {
+		// drop data that raced with unwatch().
+	} else if (cqe.res > 0 && index >= 0) {
+		d->handler(d->fd, pool.at(index), cqe.res, boost::system::error_code());
+	} else if (cqe.res == 0) {
+		this->fail(d, boost::asio::error::eof);
+	} else if (cqe.res == -EINVAL && multishot) {
+		logger.info("multishot receive not supported by this kernel, re-arming receives one by one.");
+		this->multishot = false;
+	} else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+		this->fail(d, boost::system::error_code(-cqe.res, boost::system::system_category()));
+	}
+	if (index >= 0) {
+		this->provideBuffer(index);
+	}
+	if (!d->recvArmed && !d->closing && !d->paused) {
+		// the buffer just given back is queued ahead of this, so ENOBUFS
+		// does not spin.
+		this->armRecv(d);
+	}
+	this->closeIfIdle(d);
+}
+
+void uring_io_engine::handleWrite(descriptor_ptr d, int position, int res) {
+	chunk& c = d->pending[position];
+	if (res > 0) {
+		c.offset += res;
+		d->queuedBytes -= res;
+		memory_governor::instance().credit(res);
+	} else if (res != -ECANCELED && d->chainError == 0) {
+		d->chainError = res == 0 ? EPIPE : -res;
+	}
+	if (++d->chainReaped < d->chainLength) {
+		return;
+	}
+	d->chainLength = 0;
+	while (!d->pending.empty() && d->pending.front().offset == d->pending.front().len) {
+		this->releaseChunk(d->pending.front());
+		d->pending.pop_front();
+	}
+	if (d->chainError != 0) {
+		this->fail(d, boost::system::error_code(d->chainError, boost::system::system_category()));
+	} else {
+		if (!d->pending.empty() && !d->queued) {
+			d->queued = true;
+			this->dirty.push_back(d);
+		}
+		if (d->writeHandler && !d->closing) {
+			d->writeHandler(d->fd, d->queuedBytes);
+		}
+	}
+	this->closeIfIdle(d);
+}
+
+/**
+ * report the first error on a descriptor to its handler, then drop it.
+ */
+void uring_io_engine::fail(descriptor_ptr d, const boost::system::error_code& ec) {
+	if (d->closing) {
+		return;
+	}
+	d->handler(d->fd, NULL, 0, ec);
+	this->unwatch(d->fd);
+}
+
+void uring_io_engine::closeIfIdle(descriptor_ptr d) {
+	if (!d->closing || d->recvArmed || d->chainLength > 0) {
+		return;
+	}
+	for (std::size_t i = 0; i < d->pending.size(); i++) {
+		this->releaseChunk(d->pending[i]);
+	}
+	d->pending.clear();
+	memory_governor::instance().credit(d->queuedBytes);
+	d->queuedBytes = 0;
+	std::map<int, descriptor_ptr>::iterator it = descriptors.find(d->fd);
+	if (it != descriptors.end() && it->second == d) {
+		descriptors.erase(it);
+		if (d->keepOpen) {
+			this->post(d->released);
+		} else {
+			::close(d->fd);
+		}
+	}
+}
+
+void uring_io_engine::releaseChunk(chunk& c) {
+	if (c.index >= 0) {
+		pool.release(c.index);
+		c.index = -1;
+	}
+}
+
+uring_io_engine::~uring_io_engine() {
+	for (std::map<int, descriptor_ptr>::iterator it = descriptors.begin(); it != descriptors.end(); ++it) {
+		for (std::size_t i = 0; i < it->second->pending.size(); i++) {
+			this->releaseChunk(it->second->pending[i]);
+		}
+		memory_governor::instance().credit(it->second->queuedBytes);
+		::close(it->first);
+	}
+	// closing the ring drops every request still in flight, so the kernel is
+	// done with the buffers once close returns.
+	if (ringFd >= 0) {
+		::close(ringFd);
+	}
+	if (sqes != MAP_FAILED) {
+		munmap(sqes, sqesSize);
+	}
+	if (cqRing != MAP_FAILED && cqRing != sqRing) {
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing != MAP_FAILED) {
+		munmap(sqRing, sqRingSize);
+	}
+	if (wakeFd >= 0) {
+		::close(wakeFd);
+	}
+	for (std::size_t i = 0; i < recvBuffers.size(); i++) {
+		pool.release(recvBuffers[i]);
+	}
+}
+
+#else
+
+uring_io_engine::uring_io_engine(packet_pool& pool) :
+		pool(pool), stopRequested(false) {
+}
+
+boost::shared_ptr<io_engine> uring_io_engine::create(packet_pool& pool) {
+	return boost::shared_ptr<io_engine>();
+}
+
+void uring_io_engine::watch(int fd, read_handler handler) {
+}
+
+void uring_io_engine::unwatch(int fd) {
+}
+
+void uring_io_engine::release(int fd, boost::function<void()> released) {
+}
+
+void uring_io_engine::write(int fd, const unsigned char* data, std::size_t len) {
+}
+
+void uring_io_engine::pauseReads(int fd) {
+}
+
+void uring_io_engine::resumeReads(int fd) {
+}
+
+std::size_t uring_io_engine::getQueuedBytes(int fd) {
+	return 0;
+}
+
+void uring_io_engine::setWriteHandler(int fd, write_handler handler) {
+}
+
+void uring_io_engine::run() {
+}
+
+void uring_io_engine::post(boost::function<void()> handler) {
+}
+
+void uring_io_engine::setTicker(int intervalMs, boost::function<void()> handler) {
+}
+
+void uring_io_engine::stop() {
+}
+
+std::string uring_io_engine::getName() {
+	return "uring";
+}
+
+uring_io_engine::~uring_io_engine() {
+}
+
+#endif
+
+} /* namespace rtunnel */
@@ -0,0 +1,153 @@
+/*
+ * uringioengine.hpp
+ *
+ *  Created on: 2026年10月19日
+ *      Author: jeremy
+ */
+
+#ifndef URINGIOENGINE_HPP_
+#define URINGIOENGINE_HPP_
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RTUNNEL_HAVE_IO_URING 1
+#endif
+#endif
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <log4cpp/Category.hh>
+#include "ioengine.hpp"
+
+#ifdef RTUNNEL_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace rtunnel {
+
+/**
+ * io_engine driving the descriptors through io_uring (linux only).
+ *
+ * The packet pool is registered with the ring: part of it is handed to the
+ * kernel as provided buffers for multishot receives, the rest backs fixed
+ * buffer writes. Writes queued for a descriptor are submitted as one linked
+ * chain so they stay ordered, and everything the handlers queue during one
+ * pass over the completion queue goes to the kernel in a single
+ * io_uring_enter.
+ */
+class uring_io_engine: public io_engine {
+public:
+	/**
+	 * @return the engine, or an empty pointer if io_uring can not be set
+	 *         up (old kernel, seccomp, not linux).
+	 */
+	static boost::shared_ptr<io_engine> create(packet_pool& pool);
+
+	void watch(int fd, read_handler handler);
+	void unwatch(int fd);
+	void release(int fd, boost::function<void()> released);
+	void write(int fd, const unsigned char* data, std::size_t len);
+	void pauseReads(int fd);
+	void resumeReads(int fd);
+	std::size_t getQueuedBytes(int fd);
+	void setWriteHandler(int fd, write_handler handler);
+	void post(boost::function<void()> handler);
+	void setTicker(int intervalMs, boost::function<void()> handler);
+	void run();
+	void stop();
+	std::string getName();
+
+	virtual ~uring_io_engine();
+private:
+	uring_io_engine(packet_pool& pool);
+
+#ifdef RTUNNEL_HAVE_IO_URING
+	struct chunk {
+		int index;
+		std::size_t offset;
+		std::size_t len;
+		boost::shared_ptr<std::vector<unsigned char> > heap;
+	};
+	struct descriptor {
+		int fd;
+		read_handler handler;
+		write_handler writeHandler;
+		std::deque<chunk> pending;
+		int chainLength;
+		int chainReaped;
+		int chainError;
+		bool queued;
+		bool recvArmed;
+		bool stream;
+		std::size_t queuedBytes;
+		bool paused;
+		bool closing;
+		// released rather than closed once idle
+		bool keepOpen;
+		boost::function<void()> released;
+	};
+	typedef boost::shared_ptr<descriptor> descriptor_ptr;
+
+	static log4cpp::Category& logger;
+	static const unsigned int RING_ENTRIES;
+	static const int BUFFER_GROUP;
+	static const int MAX_CHAIN;
+
+	bool setup();
+	io_uring_sqe* nextSqe();
+	int submit(unsigned int waitFor);
+	void reap();
+	void complete(const io_uring_cqe& cqe);
+	void armRecv(descriptor_ptr d);
+	void cancelRecv(descriptor_ptr d);
+	void provideBuffer(int index);
+	void armWakeup();
+	void armTicker();
+	void flushWrites(descriptor_ptr d);
+	void handleRecv(descriptor_ptr d, const io_uring_cqe& cqe);
+	void handleWrite(descriptor_ptr d, int position, int res);
+	void fail(descriptor_ptr d, const boost::system::error_code& ec);
+	void closeIfIdle(descriptor_ptr d);
+	void wakeup();
+	void releaseChunk(chunk& c);
+
+	int ringFd;
+	int wakeFd;
+	unsigned long long wakeValue;
+	void* sqRing;
+	std::size_t sqRingSize;
+	void* cqRing;
+	std::size_t cqRingSize;
+	io_uring_sqe* sqes;
+	std::size_t sqesSize;
+	unsigned int* sqHead;
+	unsigned int* sqTail;
+	unsigned int* sqMask;
+	unsigned int* sqArray;
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	unsigned int* cqMask;
+	io_uring_cqe* cqes;
+	unsigned int sqLocalTail;
+	unsigned int toSubmit;
+	unsigned int sqEntries;
+	bool multishot;
+	bool fixedBuffers;
+	std::vector<int> recvBuffers;
+	std::map<int, descriptor_ptr> descriptors;
+	std::vector<descriptor_ptr> dirty;
+	std::vector<boost::function<void()> > posted;
+	__kernel_timespec tickSpec;
+	bool tickArmed;
+	boost::function<void()> tickHandler;
+	boost::mutex postMutex;
+#endif
+	packet_pool& pool;
+	boost::atomic<bool> stopRequested;
+};
+
+} /* namespace rtunnel */
+#endif /* URINGIOENGINE_HPP_ */